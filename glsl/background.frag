@@ -6,7 +6,12 @@ in vec2 TexCoord;
 
 uniform sampler2D ourTexture;
 
+// lens undistortion: texture coordinate to sample for each displayed texture coordinate
+uniform sampler2D undistortMap;
+uniform bool undistort;
+
 void main()
 {
-    FragColor = texture(ourTexture, TexCoord);
+    vec2 coord = undistort ? texture(undistortMap, TexCoord).xy : TexCoord;
+    FragColor = texture(ourTexture, coord);
 }
\ No newline at end of file
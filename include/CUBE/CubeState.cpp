@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <CUBE/Facelets.cpp>
+
+/*
+ * The 18 face turns, in the order U U2 U' R R2 R' F F2 F' D D2 D' L L2 L' B B2 B'. move / 3 is the face,
+ * move % 3 + 1 the number of quarter turns clockwise.
+ */
+static const int MOVE_COUNT = 18;
+
+static const char *moveNames[MOVE_COUNT] = {
+        "U", "U2", "U'", "R", "R2", "R'", "F", "F2", "F'", "D", "D2", "D'", "L", "L2", "L'", "B", "B2", "B'"};
+
+inline int moveFace(int move) { return move / 3; }
+inline int inverseMove(int move) { return move - move % 3 + 2 - move % 3; }
+
+/*
+ * Cube at the cubie level: which cubie sits in each slot and how it is turned, packed in two words.
+ *
+ *  - corners: one byte per slot (slot i in bits 8i..8i+7), cubie in bits 0-2 and twist (0..2) in bits 3-4;
+ *  - edges: five bits per slot (slot i in bits 5i..5i+4), cubie in bits 0-3 and flip in bit 4.
+ *
+ * Slots, cubies and orientations follow CUBE/Facelets.cpp. State a * b is "a, then b": the cube b applied to a.
+ */
+struct CubeState {
+    uint64_t corners;
+    uint64_t edges;
+
+    static CubeState solved() {
+        CubeState s;
+        s.corners = 0;
+        s.edges = 0;
+        for (int i = 0; i < CORNER_COUNT; i++) s.corners |= (uint64_t) i << (8 * i);
+        for (int i = 0; i < EDGE_COUNT; i++) s.edges |= (uint64_t) i << (5 * i);
+        return s;
+    }
+
+    int corner(int slot) const { return (int) (corners >> (8 * slot)) & 7; }
+    int cornerTwist(int slot) const { return (int) (corners >> (8 * slot + 3)) & 3; }
+    int edge(int slot) const { return (int) (edges >> (5 * slot)) & 15; }
+    int edgeFlip(int slot) const { return (int) (edges >> (5 * slot + 4)) & 1; }
+
+    void setCorner(int slot, int cubie, int twist) {
+        corners = (corners & ~((uint64_t) 0xff << (8 * slot))) | (uint64_t) (cubie | twist << 3) << (8 * slot);
+    }
+
+    void setEdge(int slot, int cubie, int flip) {
+        edges = (edges & ~((uint64_t) 31 << (5 * slot))) | (uint64_t) (cubie | flip << 4) << (5 * slot);
+    }
+
+    bool operator==(const CubeState &o) const { return corners == o.corners && edges == o.edges; }
+    bool operator!=(const CubeState &o) const { return !(*this == o); }
+
+    bool isSolved() const { return *this == solved(); }
+
+    /*
+     * This cube, then b.
+     */
+    CubeState operator*(const CubeState &b) const {
+        CubeState r;
+        r.corners = 0;
+        r.edges = 0;
+        for (int i = 0; i < CORNER_COUNT; i++) {
+            int from = b.corner(i);
+            r.corners |= (uint64_t) (corner(from) | ((cornerTwist(from) + b.cornerTwist(i)) % 3) << 3) << (8 * i);
+        }
+        for (int i = 0; i < EDGE_COUNT; i++) {
+            int from = b.edge(i);
+            r.edges |= (uint64_t) (edge(from) | (edgeFlip(from) ^ b.edgeFlip(i)) << 4) << (5 * i);
+        }
+        return r;
+    }
+
+    CubeState inverse() const {
+        CubeState r;
+        r.corners = 0;
+        r.edges = 0;
+        for (int i = 0; i < CORNER_COUNT; i++)
+            r.corners |= (uint64_t) (i | ((3 - cornerTwist(i)) % 3) << 3) << (8 * corner(i));
+        for (int i = 0; i < EDGE_COUNT; i++)
+            r.edges |= (uint64_t) (i | edgeFlip(i) << 4) << (5 * edge(i));
+        return r;
+    }
+
+    /*
+     * Apply one of the 18 moves, through the precomputed tables of MoveTables.
+     */
+    inline CubeState move(int m) const;
+
+    CubeState moves(const std::vector<int> &sequence) const {
+        CubeState s = *this;
+        for (size_t i = 0; i < sequence.size(); i++) s = s.move(sequence[i]);
+        return s;
+    }
+
+    /*
+     * Check that the cube can be solved. Returns NULL if so, otherwise what is wrong with it.
+     */
+    const char *verify() const {
+        int cornerSeen = 0, edgeSeen = 0, twist = 0, flip = 0;
+        for (int i = 0; i < CORNER_COUNT; i++) {
+            cornerSeen |= 1 << corner(i);
+            if (cornerTwist(i) > 2) return "invalid corner twist";
+            twist += cornerTwist(i);
+        }
+        for (int i = 0; i < EDGE_COUNT; i++) {
+            if (edge(i) >= EDGE_COUNT) return "invalid edge";
+            edgeSeen |= 1 << edge(i);
+            flip += edgeFlip(i);
+        }
+        if (cornerSeen != (1 << CORNER_COUNT) - 1) return "a corner is missing";
+        if (edgeSeen != (1 << EDGE_COUNT) - 1) return "an edge is missing";
+        if (twist % 3 != 0) return "a corner is twisted";
+        if (flip % 2 != 0) return "an edge is flipped";
+        if (cornerParity() != edgeParity()) return "two pieces are swapped";
+        return NULL;
+    }
+
+    int cornerParity() const {
+        int p = 0;
+        for (int i = 0; i < CORNER_COUNT; i++)
+            for (int j = i + 1; j < CORNER_COUNT; j++)
+                if (corner(i) > corner(j)) p ^= 1;
+        return p;
+    }
+
+    int edgeParity() const {
+        int p = 0;
+        for (int i = 0; i < EDGE_COUNT; i++)
+            for (int j = i + 1; j < EDGE_COUNT; j++)
+                if (edge(i) > edge(j)) p ^= 1;
+        return p;
+    }
+
+    /*
+     * Read a facelet string (54 face letters). Returns NULL on success, otherwise what is wrong with it.
+     */
+    static const char *fromFacelets(const std::string &facelets, CubeState &state) {
+        if (facelets.size() != (size_t) FACELET_COUNT) return "a facelet string has 54 letters";
+        int face[FACELET_COUNT], count[FACE_COUNT] = {};
+        for (int i = 0; i < FACELET_COUNT; i++) {
+            face[i] = -1;
+            for (int f = 0; f < FACE_COUNT; f++)
+                if (facelets[i] == faceNames[f]) face[i] = f;
+            if (face[i] < 0) return "facelets must be one of U R F D L B";
+            count[face[i]]++;
+        }
+        for (int f = 0; f < FACE_COUNT; f++) {
+            if (count[f] != 9) return "every face letter must appear 9 times";
+            if (face[facelet(f, 5)] != f) return "the centers must be U R F D L B";
+        }
+
+        state.corners = 0;
+        state.edges = 0;
+        for (int i = 0; i < CORNER_COUNT; i++) {
+            // the U or D sticker gives the twist, the two next ones clockwise name the cubie
+            int twist = 0;
+            while (twist < 3 && face[cornerFacelet[i][twist]] != FACE_U && face[cornerFacelet[i][twist]] != FACE_D)
+                twist++;
+            if (twist == 3) return "a corner has no U or D sticker";
+            int c1 = face[cornerFacelet[i][(twist + 1) % 3]], c2 = face[cornerFacelet[i][(twist + 2) % 3]];
+            int cubie = -1;
+            for (int j = 0; j < CORNER_COUNT; j++)
+                if (cornerColor[j][1] == c1 && cornerColor[j][2] == c2
+                    && cornerColor[j][0] == face[cornerFacelet[i][twist]])
+                    cubie = j;
+            if (cubie < 0) return "a corner does not exist";
+            state.setCorner(i, cubie, twist);
+        }
+        for (int i = 0; i < EDGE_COUNT; i++) {
+            int cubie = -1, flip = 0;
+            for (int j = 0; j < EDGE_COUNT; j++) {
+                for (int o = 0; o < 2; o++) {
+                    if (face[edgeFacelet[i][o]] == edgeColor[j][0] && face[edgeFacelet[i][(o + 1) % 2]] == edgeColor[j][1]) {
+                        cubie = j;
+                        flip = o;
+                    }
+                }
+            }
+            if (cubie < 0) return "an edge does not exist";
+            state.setEdge(i, cubie, flip);
+        }
+        return state.verify();
+    }
+
+    std::string toFacelets() const {
+        std::string s(FACELET_COUNT, '?');
+        for (int f = 0; f < FACE_COUNT; f++) s[facelet(f, 5)] = faceNames[f];
+        for (int i = 0; i < CORNER_COUNT; i++)
+            for (int n = 0; n < 3; n++)
+                s[cornerFacelet[i][(n + cornerTwist(i)) % 3]] = faceNames[cornerColor[corner(i)][n]];
+        for (int i = 0; i < EDGE_COUNT; i++)
+            for (int n = 0; n < 2; n++)
+                s[edgeFacelet[i][(n + edgeFlip(i)) % 2]] = faceNames[edgeColor[edge(i)][n]];
+        return s;
+    }
+
+    /*
+     * Uniformly random solvable cube.
+     */
+    template<typename Rng>
+    static CubeState random(Rng &rng) {
+        int cp[CORNER_COUNT], ep[EDGE_COUNT];
+        for (int i = 0; i < CORNER_COUNT; i++) cp[i] = i;
+        for (int i = 0; i < EDGE_COUNT; i++) ep[i] = i;
+        for (int i = CORNER_COUNT - 1; i > 0; i--) std::swap(cp[i], cp[std::uniform_int_distribution<int>(0, i)(rng)]);
+        for (int i = EDGE_COUNT - 1; i > 0; i--) std::swap(ep[i], ep[std::uniform_int_distribution<int>(0, i)(rng)]);
+
+        CubeState s;
+        s.corners = 0;
+        s.edges = 0;
+        int twist = 0, flip = 0;
+        for (int i = 0; i < CORNER_COUNT; i++) {
+            int t = i + 1 < CORNER_COUNT ? std::uniform_int_distribution<int>(0, 2)(rng) : (3 - twist % 3) % 3;
+            twist += t;
+            s.setCorner(i, cp[i], t);
+        }
+        for (int i = 0; i < EDGE_COUNT; i++) {
+            int f = i + 1 < EDGE_COUNT ? std::uniform_int_distribution<int>(0, 1)(rng) : flip % 2;
+            flip += f;
+            s.setEdge(i, ep[i], f);
+        }
+        // fix the permutation parity by swapping two edges
+        if (s.cornerParity() != s.edgeParity()) {
+            int e0 = s.edge(0), f0 = s.edgeFlip(0);
+            s.setEdge(0, s.edge(1), s.edgeFlip(1));
+            s.setEdge(1, e0, f0);
+        }
+        return s;
+    }
+};
+
+/*
+ * The six quarter turns as cubes (cubie that moves into each slot and its orientation change), U R F D L B.
+ */
+static const int basicMoveCorners[FACE_COUNT][CORNER_COUNT] = {
+        {UBR, URF, UFL, ULB, DFR, DLF, DBL, DRB},
+        {DFR, UFL, ULB, URF, DRB, DLF, DBL, UBR},
+        {UFL, DLF, ULB, UBR, URF, DFR, DBL, DRB},
+        {URF, UFL, ULB, UBR, DLF, DBL, DRB, DFR},
+        {URF, ULB, DBL, UBR, DFR, UFL, DLF, DRB},
+        {URF, UFL, UBR, DRB, DFR, DLF, ULB, DBL}};
+
+static const int basicMoveTwists[FACE_COUNT][CORNER_COUNT] = {
+        {0, 0, 0, 0, 0, 0, 0, 0},
+        {2, 0, 0, 1, 1, 0, 0, 2},
+        {1, 2, 0, 0, 2, 1, 0, 0},
+        {0, 0, 0, 0, 0, 0, 0, 0},
+        {0, 1, 2, 0, 0, 2, 1, 0},
+        {0, 0, 1, 2, 0, 0, 2, 1}};
+
+static const int basicMoveEdges[FACE_COUNT][EDGE_COUNT] = {
+        {UB, UR, UF, UL, DR, DF, DL, DB, FR, FL, BL, BR},
+        {FR, UF, UL, UB, BR, DF, DL, DB, DR, FL, BL, UR},
+        {UR, FL, UL, UB, DR, FR, DL, DB, UF, DF, BL, BR},
+        {UR, UF, UL, UB, DF, DL, DB, DR, FR, FL, BL, BR},
+        {UR, UF, BL, UB, DR, DF, FL, DB, FR, UL, DL, BR},
+        {UR, UF, UL, BR, DR, DF, DL, BL, FR, FL, UB, DB}};
+
+static const int basicMoveFlips[FACE_COUNT][EDGE_COUNT] = {
+        {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+        {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+        {0, 1, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0},
+        {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+        {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+        {0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 1, 1}};
+
+/*
+ * Per-move lookup tables for CubeState::move(). For every move and slot: the slot the cubie comes from, and the
+ * new value of the packed field given the old one, so the orientation change is a table lookup as well.
+ */
+struct MoveTables {
+    CubeState moveCube[MOVE_COUNT];
+    uint8_t cornerFrom[MOVE_COUNT][CORNER_COUNT];
+    uint8_t cornerField[MOVE_COUNT][CORNER_COUNT][32];
+    uint8_t edgeFrom[MOVE_COUNT][EDGE_COUNT];
+    uint8_t edgeFlip[MOVE_COUNT][EDGE_COUNT];
+
+    MoveTables() {
+        for (int face = 0; face < FACE_COUNT; face++) {
+            CubeState quarter;
+            quarter.corners = 0;
+            quarter.edges = 0;
+            for (int i = 0; i < CORNER_COUNT; i++) quarter.setCorner(i, basicMoveCorners[face][i], basicMoveTwists[face][i]);
+            for (int i = 0; i < EDGE_COUNT; i++) quarter.setEdge(i, basicMoveEdges[face][i], basicMoveFlips[face][i]);
+
+            CubeState turn = quarter;
+            for (int power = 0; power < 3; power++) {
+                moveCube[face * 3 + power] = turn;
+                turn = turn * quarter;
+            }
+        }
+
+        for (int m = 0; m < MOVE_COUNT; m++) {
+            for (int i = 0; i < CORNER_COUNT; i++) {
+                cornerFrom[m][i] = (uint8_t) moveCube[m].corner(i);
+                for (int field = 0; field < 32; field++) {
+                    int twist = ((field >> 3) + moveCube[m].cornerTwist(i)) % 3;
+                    cornerField[m][i][field] = (uint8_t) ((field & 7) | twist << 3);
+                }
+            }
+            for (int i = 0; i < EDGE_COUNT; i++) {
+                edgeFrom[m][i] = (uint8_t) moveCube[m].edge(i);
+                edgeFlip[m][i] = (uint8_t) (moveCube[m].edgeFlip(i) << 4);
+            }
+        }
+    }
+};
+
+static const MoveTables moveTables;
+
+inline CubeState CubeState::move(int m) const {
+    CubeState r;
+    uint64_t c = 0, e = 0;
+    const uint8_t *cornerFrom = moveTables.cornerFrom[m];
+    for (int i = 0; i < CORNER_COUNT; i++) {
+        unsigned field = (unsigned) (corners >> (8 * cornerFrom[i])) & 31;
+        c |= (uint64_t) moveTables.cornerField[m][i][field] << (8 * i);
+    }
+    const uint8_t *edgeFrom = moveTables.edgeFrom[m];
+    for (int i = 0; i < EDGE_COUNT; i++) {
+        unsigned field = (unsigned) (edges >> (5 * edgeFrom[i])) & 31;
+        e |= (uint64_t) (field ^ moveTables.edgeFlip[m][i]) << (5 * i);
+    }
+    r.corners = c;
+    r.edges = e;
+    return r;
+}
+
+/*
+ * Parse a move sequence such as "R U R' U'". Returns false on an unknown move.
+ */
+inline bool parseMoves(const std::string &text, std::vector<int> &sequence) {
+    sequence.clear();
+    size_t i = 0;
+    while (i < text.size()) {
+        if (text[i] == ' ') {
+            i++;
+            continue;
+        }
+        int face = -1;
+        for (int f = 0; f < FACE_COUNT; f++)
+            if (text[i] == faceNames[f]) face = f;
+        if (face < 0) return false;
+        int power = 0;
+        if (i + 1 < text.size() && text[i + 1] == '2') power = 1;
+        else if (i + 1 < text.size() && (text[i + 1] == '\'' || text[i + 1] == '3')) power = 2;
+        sequence.push_back(face * 3 + power);
+        i += power == 0 ? 1 : 2;
+    }
+    return true;
+}
+
+inline std::string formatMoves(const std::vector<int> &sequence) {
+    std::string s;
+    for (size_t i = 0; i < sequence.size(); i++) {
+        if (i) s += ' ';
+        s += moveNames[sequence[i]];
+    }
+    return s;
+}
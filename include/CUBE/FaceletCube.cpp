@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FACELET_CUBE_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define FACELET_CUBE_NEON
+#endif
+
+#include <CUBE/CubeState.cpp>
+
+/*
+ * Cube as its 54 stickers (face letters in facelet order), padded to 64 bytes so that it fits one AVX-512 register,
+ * four SSE/NEON registers or one cache line.
+ */
+struct alignas(64) FaceletCube {
+    uint8_t stickers[64];
+
+    static FaceletCube fromString(const std::string &facelets) {
+        FaceletCube c;
+        std::memset(c.stickers, 0, sizeof(c.stickers));
+        std::memcpy(c.stickers, facelets.data(), facelets.size() < (size_t) FACELET_COUNT ? facelets.size() : FACELET_COUNT);
+        return c;
+    }
+
+    static FaceletCube solved() { return fromString(CubeState::solved().toFacelets()); }
+
+    std::string toString() const { return std::string((const char *) stickers, FACELET_COUNT); }
+
+    bool operator==(const FaceletCube &o) const { return std::memcmp(stickers, o.stickers, sizeof(stickers)) == 0; }
+    bool operator!=(const FaceletCube &o) const { return !(*this == o); }
+
+    /*
+     * Every face in the color of its center.
+     */
+    bool isSolved() const {
+        for (int f = 0; f < FACE_COUNT; f++)
+            for (int p = 1; p <= 9; p++)
+                if (stickers[facelet(f, p)] != stickers[facelet(f, 5)]) return false;
+        return true;
+    }
+};
+
+/*
+ * A face turn moves stickers and nothing else, so on the facelet form every move is a fixed byte permutation:
+ * after move m, sticker i is the sticker that was at source[m][i]. Indices 54..63 map to themselves.
+ */
+struct FaceletMoveTables {
+    alignas(64) uint8_t source[MOVE_COUNT][64];
+#ifdef FACELET_CUBE_X86
+    // per move, output chunk and input chunk: pshufb indices, 0x80 where the sticker comes from another chunk
+    alignas(16) uint8_t chunkMask[MOVE_COUNT][4][4][16];
+#endif
+
+    FaceletMoveTables() {
+        for (int m = 0; m < MOVE_COUNT; m++) {
+            const CubeState &turn = moveTables.moveCube[m];
+            for (int i = 0; i < 64; i++) source[m][i] = (uint8_t) i;
+            for (int i = 0; i < CORNER_COUNT; i++)
+                for (int n = 0; n < 3; n++)
+                    source[m][cornerFacelet[i][(n + turn.cornerTwist(i)) % 3]] = (uint8_t) cornerFacelet[turn.corner(i)][n];
+            for (int i = 0; i < EDGE_COUNT; i++)
+                for (int n = 0; n < 2; n++)
+                    source[m][edgeFacelet[i][(n + turn.edgeFlip(i)) % 2]] = (uint8_t) edgeFacelet[turn.edge(i)][n];
+#ifdef FACELET_CUBE_X86
+            for (int out = 0; out < 4; out++)
+                for (int in = 0; in < 4; in++)
+                    for (int b = 0; b < 16; b++) {
+                        int s = source[m][out * 16 + b];
+                        chunkMask[m][out][in][b] = s / 16 == in ? (uint8_t) (s % 16) : 0x80;
+                    }
+#endif
+        }
+    }
+};
+
+static const FaceletMoveTables faceletMoveTables;
+
+/*
+ * Implementations of "apply this move sequence", the loop inside so the cube stays in registers between moves.
+ */
+typedef void (*FaceletMovesFunction)(FaceletCube &cube, const uint8_t *moves, size_t count);
+
+inline void faceletMovesScalar(FaceletCube &cube, const uint8_t *moves, size_t count) {
+    uint8_t tmp[64];
+    for (size_t k = 0; k < count; k++) {
+        const uint8_t *src = faceletMoveTables.source[moves[k]];
+        for (int i = 0; i < 64; i++) tmp[i] = cube.stickers[src[i]];
+        std::memcpy(cube.stickers, tmp, sizeof(tmp));
+    }
+}
+
+#ifdef FACELET_CUBE_X86
+/*
+ * pshufb only shuffles within 16 bytes: every output chunk is the OR of the four input chunks shuffled by masks
+ * that zero the bytes coming from elsewhere.
+ */
+__attribute__((target("ssse3")))
+inline void faceletMovesSsse3(FaceletCube &cube, const uint8_t *moves, size_t count) {
+    __m128i in[4], out[4];
+    for (int j = 0; j < 4; j++) in[j] = _mm_load_si128((const __m128i *) (cube.stickers + 16 * j));
+    for (size_t k = 0; k < count; k++) {
+        const uint8_t (*mask)[4][16] = faceletMoveTables.chunkMask[moves[k]];
+        for (int o = 0; o < 4; o++) {
+            __m128i r = _mm_shuffle_epi8(in[0], _mm_load_si128((const __m128i *) mask[o][0]));
+            for (int j = 1; j < 4; j++)
+                r = _mm_or_si128(r, _mm_shuffle_epi8(in[j], _mm_load_si128((const __m128i *) mask[o][j])));
+            out[o] = r;
+        }
+        for (int j = 0; j < 4; j++) in[j] = out[j];
+    }
+    for (int j = 0; j < 4; j++) _mm_store_si128((__m128i *) (cube.stickers + 16 * j), in[j]);
+}
+
+/*
+ * vpermb permutes all 64 bytes at once: one instruction per move.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+inline void faceletMovesAvx512(FaceletCube &cube, const uint8_t *moves, size_t count) {
+    __m512i c = _mm512_load_si512((const void *) cube.stickers);
+    for (size_t k = 0; k < count; k++) {
+        __m512i idx = _mm512_load_si512((const void *) faceletMoveTables.source[moves[k]]);
+        c = _mm512_maskz_permutexvar_epi8(~(__mmask64) 0, idx, c);
+    }
+    _mm512_store_si512((void *) cube.stickers, c);
+}
+#endif
+
+#ifdef FACELET_CUBE_NEON
+/*
+ * tbl looks up 64-byte tables directly: four lookups per move.
+ */
+inline void faceletMovesNeon(FaceletCube &cube, const uint8_t *moves, size_t count) {
+    uint8x16x4_t c = vld1q_u8_x4(cube.stickers);
+    for (size_t k = 0; k < count; k++) {
+        uint8x16x4_t idx = vld1q_u8_x4(faceletMoveTables.source[moves[k]]);
+        uint8x16x4_t r;
+        r.val[0] = vqtbl4q_u8(c, idx.val[0]);
+        r.val[1] = vqtbl4q_u8(c, idx.val[1]);
+        r.val[2] = vqtbl4q_u8(c, idx.val[2]);
+        r.val[3] = vqtbl4q_u8(c, idx.val[3]);
+        c = r;
+    }
+    vst1q_u8_x4(cube.stickers, c);
+}
+#endif
+
+struct FaceletMovesImplementation {
+    const char *name;
+    FaceletMovesFunction apply;
+};
+
+/*
+ * Implementations this CPU can run, fastest last.
+ */
+inline std::vector<FaceletMovesImplementation> faceletMovesImplementations() {
+    std::vector<FaceletMovesImplementation> list;
+    list.push_back({"scalar", faceletMovesScalar});
+#ifdef FACELET_CUBE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) list.push_back({"ssse3", faceletMovesSsse3});
+    if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw"))
+        list.push_back({"avx512vbmi", faceletMovesAvx512});
+#endif
+#ifdef FACELET_CUBE_NEON
+    list.push_back({"neon", faceletMovesNeon});
+#endif
+    return list;
+}
+
+/*
+ * Apply a move sequence with the fastest implementation, chosen once at first use.
+ */
+inline void applyFaceletMoves(FaceletCube &cube, const uint8_t *moves, size_t count) {
+    static const FaceletMovesFunction best = faceletMovesImplementations().back().apply;
+    best(cube, moves, count);
+}
+
+inline void applyFaceletMoves(FaceletCube &cube, const std::vector<int> &sequence) {
+    std::vector<uint8_t> moves(sequence.begin(), sequence.end());
+    applyFaceletMoves(cube, moves.data(), moves.size());
+}
+
+/*
+ * Whether the sequence solves the cube given as a facelet string.
+ */
+inline bool verifySolution(const std::string &facelets, const std::vector<int> &solution) {
+    FaceletCube cube = FaceletCube::fromString(facelets);
+    applyFaceletMoves(cube, solution);
+    return cube.isSolved();
+}
+
+/*
+ * Whether a cubie-level state shows exactly the given stickers, e.g. the cube read by the vision stage.
+ */
+inline bool faceletsMatch(const std::string &facelets, const CubeState &state) {
+    return FaceletCube::fromString(facelets) == FaceletCube::fromString(state.toFacelets());
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+/*
+ * Facelet layout of the cube, shared by the vision stage and the cube model.
+ *
+ * The 54 facelets are numbered face by face in the order U R F D L B, each face row by row as it appears in the
+ * usual net (U seen from above with F at the bottom, D seen from below with F at the top, the side faces with U at
+ * the top). A facelet string is the letter of the face each sticker belongs to, e.g. "UUUUUUUUURRR...".
+ */
+enum Face {
+    FACE_U = 0,
+    FACE_R,
+    FACE_F,
+    FACE_D,
+    FACE_L,
+    FACE_B,
+    FACE_COUNT
+};
+
+static const char faceNames[FACE_COUNT] = {'U', 'R', 'F', 'D', 'L', 'B'};
+
+static const int FACELET_COUNT = 54;
+static const int CORNER_COUNT = 8;
+static const int EDGE_COUNT = 12;
+
+/*
+ * Facelet of face f at position p (1..9 as in the usual U1..U9 notation).
+ */
+constexpr int facelet(int f, int p) {
+    return f * 9 + p - 1;
+}
+
+/*
+ * Corners URF UFL ULB UBR DFR DLF DBL DRB, edges UR UF UL UB DR DF DL DB FR FL BL BR.
+ */
+enum Corner { URF = 0, UFL, ULB, UBR, DFR, DLF, DBL, DRB };
+enum Edge { UR = 0, UF, UL, UB, DR, DF, DL, DB, FR, FL, BL, BR };
+
+/*
+ * Facelets of each corner position, clockwise starting with the U or D facelet.
+ */
+static const int cornerFacelet[CORNER_COUNT][3] = {
+        {facelet(FACE_U, 9), facelet(FACE_R, 1), facelet(FACE_F, 3)},
+        {facelet(FACE_U, 7), facelet(FACE_F, 1), facelet(FACE_L, 3)},
+        {facelet(FACE_U, 1), facelet(FACE_L, 1), facelet(FACE_B, 3)},
+        {facelet(FACE_U, 3), facelet(FACE_B, 1), facelet(FACE_R, 3)},
+        {facelet(FACE_D, 3), facelet(FACE_F, 9), facelet(FACE_R, 7)},
+        {facelet(FACE_D, 1), facelet(FACE_L, 9), facelet(FACE_F, 7)},
+        {facelet(FACE_D, 7), facelet(FACE_B, 9), facelet(FACE_L, 7)},
+        {facelet(FACE_D, 9), facelet(FACE_R, 9), facelet(FACE_B, 7)}};
+
+/*
+ * Facelets of each edge position, starting with the U/D facelet (F/B for the middle layer edges).
+ */
+static const int edgeFacelet[EDGE_COUNT][2] = {
+        {facelet(FACE_U, 6), facelet(FACE_R, 2)}, {facelet(FACE_U, 8), facelet(FACE_F, 2)},
+        {facelet(FACE_U, 4), facelet(FACE_L, 2)}, {facelet(FACE_U, 2), facelet(FACE_B, 2)},
+        {facelet(FACE_D, 6), facelet(FACE_R, 8)}, {facelet(FACE_D, 2), facelet(FACE_F, 8)},
+        {facelet(FACE_D, 4), facelet(FACE_L, 8)}, {facelet(FACE_D, 8), facelet(FACE_B, 8)},
+        {facelet(FACE_F, 6), facelet(FACE_R, 4)}, {facelet(FACE_F, 4), facelet(FACE_L, 6)},
+        {facelet(FACE_B, 6), facelet(FACE_L, 4)}, {facelet(FACE_B, 4), facelet(FACE_R, 6)}};
+
+/*
+ * Colors (named by the face of their center) of each corner and edge cubie, in the same order as the facelets.
+ * A cubie at a position with orientation o has color n on facelet (n + o) mod 3 (mod 2 for edges).
+ */
+static const int cornerColor[CORNER_COUNT][3] = {
+        {FACE_U, FACE_R, FACE_F}, {FACE_U, FACE_F, FACE_L}, {FACE_U, FACE_L, FACE_B}, {FACE_U, FACE_B, FACE_R},
+        {FACE_D, FACE_F, FACE_R}, {FACE_D, FACE_L, FACE_F}, {FACE_D, FACE_B, FACE_L}, {FACE_D, FACE_R, FACE_B}};
+
+static const int edgeColor[EDGE_COUNT][2] = {
+        {FACE_U, FACE_R}, {FACE_U, FACE_F}, {FACE_U, FACE_L}, {FACE_U, FACE_B},
+        {FACE_D, FACE_R}, {FACE_D, FACE_F}, {FACE_D, FACE_L}, {FACE_D, FACE_B},
+        {FACE_F, FACE_R}, {FACE_F, FACE_L}, {FACE_B, FACE_L}, {FACE_B, FACE_R}};
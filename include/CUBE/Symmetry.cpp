@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <CUBE/CubeState.cpp>
+
+/*
+ * Symmetries of the cube: the 48 rotations and reflections of space that map the cube onto itself, as products
+ * URF3^a F2^b U4^c LR2^d (a < 3, b < 2, c < 4, d < 2) numbered 16a + 8b + 2c + d:
+ *
+ *  - URF3: rotation by 120 degrees around the axis through the URF and DBL corners;
+ *  - F2:   rotation by 180 degrees around the F-B axis;
+ *  - U4:   rotation by 90 degrees around the U-D axis;
+ *  - LR2:  reflection in the plane between L and R.
+ *
+ * The first UD_SYMMETRY_COUNT keep the U-D axis in place; with them a corner keeps its U/D sticker facing U or D,
+ * so the twist of a conjugated cube depends on the twist alone.
+ *
+ * The conjugate of a cube by a symmetry is the same cube seen through the symmetry: turned or mirrored as a whole
+ * with the colors renamed so that the centers keep their names. It is as far from solved as the cube itself.
+ */
+static const int SYMMETRY_COUNT = 48;
+static const int UD_SYMMETRY_COUNT = 16;
+
+struct SymmetryTables {
+    int cornerSlot[SYMMETRY_COUNT][CORNER_COUNT];   // slot each corner slot is carried to
+    int cornerTurn[SYMMETRY_COUNT][CORNER_COUNT];   // facelet of that slot its first facelet lands on
+    int edgeSlot[SYMMETRY_COUNT][EDGE_COUNT];
+    int edgeTurn[SYMMETRY_COUNT][EDGE_COUNT];
+    bool mirror[SYMMETRY_COUNT];
+    int inverse[SYMMETRY_COUNT];
+    int move[SYMMETRY_COUNT][MOVE_COUNT];           // the move seen through the symmetry
+
+    SymmetryTables() {
+        // axes x (L to R), y (D to U), z (B to F)
+        static const int normal[FACE_COUNT][3] = {{0, 1, 0}, {1, 0, 0}, {0, 0, 1}, {0, -1, 0}, {-1, 0, 0}, {0, 0, -1}};
+        static const int urf3[3][3] = {{0, 1, 0}, {0, 0, 1}, {1, 0, 0}};
+        static const int f2[3][3] = {{-1, 0, 0}, {0, -1, 0}, {0, 0, 1}};
+        static const int u4[3][3] = {{0, 0, -1}, {0, 1, 0}, {1, 0, 0}};
+        static const int lr2[3][3] = {{-1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+        int matrix[SYMMETRY_COUNT][3][3];
+        for (int s = 0; s < SYMMETRY_COUNT; s++) {
+            int m[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+            for (int k = 0; k < s / 16; k++) multiply(m, urf3);
+            if (s / 8 % 2) multiply(m, f2);
+            for (int k = 0; k < s / 2 % 4; k++) multiply(m, u4);
+            if (s % 2) multiply(m, lr2);
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < 3; c++) matrix[s][r][c] = m[r][c];
+        }
+
+        for (int s = 0; s < SYMMETRY_COUNT; s++) {
+            const int (*m)[3] = matrix[s];
+            int faceTo[FACE_COUNT];
+            for (int f = 0; f < FACE_COUNT; f++) {
+                int v[3];
+                apply(m, normal[f], v);
+                for (int g = 0; g < FACE_COUNT; g++)
+                    if (v[0] == normal[g][0] && v[1] == normal[g][1] && v[2] == normal[g][2]) faceTo[f] = g;
+            }
+            mirror[s] = determinant(m) < 0;
+
+            // a slot is known by its set of faces, a facelet by its face
+            for (int i = 0; i < CORNER_COUNT; i++) {
+                for (int j = 0; j < CORNER_COUNT; j++) {
+                    int match = 0;
+                    for (int a = 0; a < 3; a++)
+                        for (int b = 0; b < 3; b++) match += faceTo[cornerColor[i][a]] == cornerColor[j][b];
+                    if (match == 3) cornerSlot[s][i] = j;
+                }
+                for (int b = 0; b < 3; b++)
+                    if (cornerColor[cornerSlot[s][i]][b] == faceTo[cornerColor[i][0]]) cornerTurn[s][i] = b;
+            }
+            for (int i = 0; i < EDGE_COUNT; i++) {
+                for (int j = 0; j < EDGE_COUNT; j++) {
+                    int match = 0;
+                    for (int a = 0; a < 2; a++)
+                        for (int b = 0; b < 2; b++) match += faceTo[edgeColor[i][a]] == edgeColor[j][b];
+                    if (match == 2) edgeSlot[s][i] = j;
+                }
+                edgeTurn[s][i] = edgeColor[edgeSlot[s][i]][0] != faceTo[edgeColor[i][0]];
+            }
+            // a mirror turns clockwise into counterclockwise
+            for (int mv = 0; mv < MOVE_COUNT; mv++)
+                move[s][mv] = faceTo[moveFace(mv)] * 3 + (mirror[s] ? 2 - mv % 3 : mv % 3);
+        }
+
+        for (int s = 0; s < SYMMETRY_COUNT; s++) {
+            for (int t = 0; t < SYMMETRY_COUNT; t++) {
+                bool identity = true;
+                for (int i = 0; i < CORNER_COUNT; i++) identity &= cornerSlot[t][cornerSlot[s][i]] == i;
+                for (int i = 0; i < EDGE_COUNT; i++) identity &= edgeSlot[t][edgeSlot[s][i]] == i;
+                if (identity && mirror[s] == mirror[t]) inverse[s] = t;
+            }
+        }
+    }
+
+private:
+    static void multiply(int m[3][3], const int by[3][3]) {
+        int r[3][3];
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++) r[i][j] = by[i][0] * m[0][j] + by[i][1] * m[1][j] + by[i][2] * m[2][j];
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++) m[i][j] = r[i][j];
+    }
+
+    static int determinant(const int m[3][3]) {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+               + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    static void apply(const int m[3][3], const int v[3], int out[3]) {
+        for (int i = 0; i < 3; i++) out[i] = m[i][0] * v[0] + m[i][1] * v[1] + m[i][2] * v[2];
+    }
+};
+
+static const SymmetryTables symmetryTables;
+
+/*
+ * The cube seen through symmetry s. The cubie h in slot i moves to the slot of i under s and becomes the cubie of
+ * h's slot under s; its orientation changes with how the symmetry turns the two slots, and a mirror reverses the
+ * sense of a corner twist.
+ */
+inline CubeState conjugate(const CubeState &c, int s) {
+    const SymmetryTables &t = symmetryTables;
+    CubeState r;
+    r.corners = 0;
+    r.edges = 0;
+    for (int i = 0; i < CORNER_COUNT; i++) {
+        int h = c.corner(i), twist = c.cornerTwist(i);
+        twist = ((t.mirror[s] ? 3 - twist : twist) + t.cornerTurn[s][i] - t.cornerTurn[s][h] + 3) % 3;
+        r.setCorner(t.cornerSlot[s][i], t.cornerSlot[s][h], twist);
+    }
+    for (int i = 0; i < EDGE_COUNT; i++) {
+        int h = c.edge(i);
+        r.setEdge(t.edgeSlot[s][i], t.edgeSlot[s][h], c.edgeFlip(i) ^ t.edgeTurn[s][i] ^ t.edgeTurn[s][h]);
+    }
+    return r;
+}
+
+/*
+ * Moves solving conjugate(c, s), from moves solving c.
+ */
+inline std::vector<int> conjugateMoves(const std::vector<int> &moves, int s) {
+    std::vector<int> r(moves.size());
+    for (size_t i = 0; i < moves.size(); i++) r[i] = symmetryTables.move[s][moves[i]];
+    return r;
+}
+
+/*
+ * Moves solving c.inverse(), from moves solving c: the same moves undone, in reverse order.
+ */
+inline std::vector<int> inverseMoves(const std::vector<int> &moves) {
+    std::vector<int> r(moves.rbegin(), moves.rend());
+    for (int &m : r) m = inverseMove(m);
+    return r;
+}
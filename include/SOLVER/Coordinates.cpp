@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COORDINATES_X86
+#endif
+
+#include <CUBE/CubeState.cpp>
+
+/*
+ * Coordinates of the two-phase algorithm: each describes one aspect of a CubeState as a small integer, so that a
+ * move becomes a table lookup and the distance to the goal can be stored per coordinate value.
+ *
+ *  - twist (3^7): orientation of the corners;
+ *  - flip (2^11): orientation of the edges;
+ *  - sliceSorted (12*11*10*9): where the four middle layer edges FR FL BL BR are and in which order. sliceSorted / 24
+ *    is the phase 1 slice coordinate (which four positions), sliceSorted % 24 their order. The slice edges are in the
+ *    middle layer exactly when sliceSorted < 24;
+ *  - cornerPerm (8!): permutation of the corners;
+ *  - udEdgePerm (8!): permutation of the eight U and D edges, defined only when the slice edges are in the middle
+ *    layer, which holds throughout phase 2.
+ *
+ * Phase 1 brings twist, flip and slice to 0, which puts the cube in the subgroup <U, D, R2, F2, L2, B2>; phase 2
+ * solves cornerPerm, udEdgePerm and the order of the slice edges within it.
+ */
+static const int TWIST_COUNT = 2187;
+static const int FLIP_COUNT = 2048;
+static const int SLICE_COUNT = 495;
+static const int SLICE_SORTED_COUNT = 11880;
+static const int SLICE_PERM_COUNT = 24;
+static const int CORNER_PERM_COUNT = 40320;
+static const int UD_EDGE_PERM_COUNT = 40320;
+
+/*
+ * Moves of phase 2: U U2 U' D D2 D' R2 F2 L2 B2.
+ */
+static const int PHASE2_MOVE_COUNT = 10;
+static const int phase2Moves[PHASE2_MOVE_COUNT] = {0, 1, 2, 9, 10, 11, 4, 7, 13, 16};
+
+inline bool isPhase2Move(int move) {
+    int face = moveFace(move);
+    return face == FACE_U || face == FACE_D || move % 3 == 1;
+}
+
+/*
+ * Binomial coefficient, n < 12.
+ */
+inline int binomial(int n, int k) {
+    if (k < 0 || k > n) return 0;
+    int r = 1;
+    for (int i = 0; i < k; i++) r = r * (n - i) / (i + 1);
+    return r;
+}
+
+/*
+ * Bits set in x. On x86 without popcnt (-mpopcnt, implied by -march=native) __builtin_popcount is a library call,
+ * slower than counting in place.
+ */
+inline int bitCount(unsigned x) {
+#if defined(__POPCNT__) || !(defined(__x86_64__) || defined(__i386__))
+    return __builtin_popcount(x);
+#else
+    x = x - (x >> 1 & 0x55555555u);
+    x = (x & 0x33333333u) + (x >> 2 & 0x33333333u);
+    return (int) (((x + (x >> 4)) & 0x0f0f0f0fu) * 0x01010101u >> 24);
+#endif
+}
+
+/*
+ * Bits set in every byte value.
+ */
+struct ByteBitCounts {
+    unsigned char count[256];
+
+    constexpr ByteBitCounts() : count() {
+        for (int i = 1; i < 256; i++) count[i] = (unsigned char) ((i & 1) + count[i / 2]);
+    }
+};
+
+static constexpr ByteBitCounts byteBitCounts;
+
+/*
+ * Ranking primitives on a set of values 0..15 held as bits: how many values of the set are below v, and the k-th
+ * value (from 0) not in the set. The first is a mask and a bit count; the second a binary search, as many steps
+ * whatever k is, which keeps the half, quarter, eighth and pair of the unused values that holds the k-th, counting
+ * them in a table. Neither branches on the values.
+ */
+inline int countBelow(unsigned set, int v) {
+    return bitCount(set & ((1u << v) - 1));
+}
+
+inline int nthUnused(unsigned set, int k) {
+    unsigned unused = ~set & 0xffff;
+    int v = 0;
+    for (int width = 8; width > 0; width >>= 1) {
+        int below = byteBitCounts.count[unused & ((1u << width) - 1)];
+        int upper = -(k >= below);
+        k -= below & upper;
+        v += width & upper;
+        unused >>= width & upper;
+    }
+    return v;
+}
+
+/*
+ * Digits of the rank of k values out of n, most significant first, digit i in base n - i.
+ */
+inline void lehmerDigits(int rank, int *digits, int n, int k) {
+    for (int i = k - 1; i >= 0; i--) {
+        digits[i] = rank % (n - i);
+        rank /= n - i;
+    }
+}
+
+/*
+ * Rank of k distinct values out of 0..n-1 (n <= 16) in order, n!/(n-k)! ranks: digit i is how many unused values are
+ * below p[i], in base n - i. And back.
+ */
+inline int partialPermutationRankPortable(const int *p, int n, int k) {
+    int rank = 0;
+    unsigned used = 0;
+    for (int i = 0; i < k; i++) {
+        rank = rank * (n - i) + p[i] - countBelow(used, p[i]);
+        used |= 1u << p[i];
+    }
+    return rank;
+}
+
+inline void partialPermutationUnrankPortable(int rank, int *p, int n, int k) {
+    int digits[16];
+    lehmerDigits(rank, digits, n, k);
+    unsigned used = 0;
+    for (int i = 0; i < k; i++) {
+        p[i] = nthUnused(used, digits[i]);
+        used |= 1u << p[i];
+    }
+}
+
+#ifdef COORDINATES_X86
+#if defined(__BMI2__)
+#define COORDINATES_BMI2_TARGET
+#else
+#define COORDINATES_BMI2_TARGET __attribute__((target("bmi2,popcnt")))
+#endif
+
+/*
+ * The same with BMI2, where the primitives take a few instructions: the mask (shlx or bzhi) and popcnt, and pdep and
+ * tzcnt.
+ */
+COORDINATES_BMI2_TARGET
+inline int partialPermutationRankBmi2(const int *p, int n, int k) {
+    int rank = 0;
+    unsigned used = 0;
+    for (int i = 0; i < k; i++) {
+        rank = rank * (n - i) + p[i] - __builtin_popcount(used & ((1u << p[i]) - 1));
+        used |= 1u << p[i];
+    }
+    return rank;
+}
+
+COORDINATES_BMI2_TARGET
+inline void partialPermutationUnrankBmi2(int rank, int *p, int n, int k) {
+    int digits[16];
+    lehmerDigits(rank, digits, n, k);
+    unsigned used = 0;
+    for (int i = 0; i < k; i++) {
+        p[i] = __builtin_ctz(_pdep_u32(1u << digits[i], ~used));
+        used |= 1u << p[i];
+    }
+}
+
+inline bool cpuHasBmi2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt");
+}
+
+/*
+ * Whether the rankings take the BMI2 versions: always when built for BMI2 (-mbmi2, or -march=native on a CPU that
+ * has it), where they are inlined, otherwise when the CPU has it. Checked once here rather than on every call.
+ */
+#if defined(__BMI2__)
+static const bool rankingBmi2 = true;
+#else
+static const bool rankingBmi2 = cpuHasBmi2();
+#endif
+#else
+static const bool rankingBmi2 = false;
+#endif
+
+inline int partialPermutationRank(const int *p, int n, int k) {
+#if defined(__BMI2__)
+    return partialPermutationRankBmi2(p, n, k);
+#elif defined(COORDINATES_X86)
+    return rankingBmi2 ? partialPermutationRankBmi2(p, n, k) : partialPermutationRankPortable(p, n, k);
+#else
+    return partialPermutationRankPortable(p, n, k);
+#endif
+}
+
+inline void partialPermutationUnrank(int rank, int *p, int n, int k) {
+#if defined(__BMI2__)
+    partialPermutationUnrankBmi2(rank, p, n, k);
+#elif defined(COORDINATES_X86)
+    if (rankingBmi2) partialPermutationUnrankBmi2(rank, p, n, k);
+    else partialPermutationUnrankPortable(rank, p, n, k);
+#else
+    partialPermutationUnrankPortable(rank, p, n, k);
+#endif
+}
+
+/*
+ * Rank of a permutation of 0..n-1 in lexicographic order (Lehmer code), and back: the digit of p[i], how many later
+ * values are smaller, is p[i] less the earlier values below it.
+ */
+inline int permutationRank(const int *p, int n) {
+    return partialPermutationRank(p, n, n);
+}
+
+inline void permutationUnrank(int rank, int *p, int n) {
+    partialPermutationUnrank(rank, p, n, n);
+}
+
+#if defined(__BMI2__)
+// twist bits of the corners in a CubeState
+static const uint64_t TWIST_BITS = 0x1818181818181818ULL;
+#endif
+
+/*
+ * Base 3 needs a multiply per digit however the digits are gathered; the plain loop is the fastest way to read them.
+ */
+inline int twistOf(const CubeState &s) {
+    int x = 0;
+    for (int i = 0; i < CORNER_COUNT - 1; i++) x = 3 * x + s.cornerTwist(i);
+    return x;
+}
+
+inline void setTwist(CubeState &s, int twist) {
+    uint64_t t = 0;
+    int sum = 0;
+    for (int i = CORNER_COUNT - 2; i >= 0; i--) {
+        t |= (uint64_t) (twist % 3) << (2 * i);
+        sum += twist % 3;
+        twist /= 3;
+    }
+    t |= (uint64_t) ((3 - sum % 3) % 3) << (2 * (CORNER_COUNT - 1));
+#if defined(__BMI2__)
+    s.corners = (s.corners & ~TWIST_BITS) | _pdep_u64(t, TWIST_BITS);
+#else
+    for (int i = 0; i < CORNER_COUNT; i++) s.setCorner(i, s.corner(i), (int) (t >> (2 * i) & 3));
+#endif
+}
+
+/*
+ * Like twist, flip is read and written one edge at a time: gathering the bits with pext measured no faster.
+ */
+inline int flipOf(const CubeState &s) {
+    int x = 0;
+    for (int i = 0; i < EDGE_COUNT - 1; i++) x = 2 * x + s.edgeFlip(i);
+    return x;
+}
+
+inline void setFlip(CubeState &s, int flip) {
+    int sum = 0;
+    for (int i = EDGE_COUNT - 2; i >= 0; i--) {
+        s.setEdge(i, s.edge(i), flip & 1);
+        sum += flip & 1;
+        flip >>= 1;
+    }
+    s.setEdge(EDGE_COUNT - 1, s.edge(EDGE_COUNT - 1), sum & 1);
+}
+
+inline int sliceSortedOf(const CubeState &s) {
+    // which positions: combinatorial number of the positions holding a slice edge, 0 for the middle layer
+    int x = 0, found = 0, order[4];
+    for (int j = EDGE_COUNT - 1; j >= 0; j--) {
+        int e = s.edge(j);
+        if (e >= FR) {
+            x += binomial(EDGE_COUNT - 1 - j, found + 1);
+            order[3 - found] = e - FR;
+            found++;
+        }
+    }
+    return SLICE_PERM_COUNT * x + permutationRank(order, 4);
+}
+
+/*
+ * Place the slice edges as given; the other edges fill the remaining positions in order, unflipped.
+ */
+inline void setSliceSorted(CubeState &s, int sliceSorted) {
+    int x = sliceSorted / SLICE_PERM_COUNT, order[4];
+    permutationUnrank(sliceSorted % SLICE_PERM_COUNT, order, 4);
+
+    // decode the combinatorial number from the lowest position, which contributed the largest term
+    bool slice[EDGE_COUNT] = {};
+    int found = 3;
+    for (int j = 0; j < EDGE_COUNT && found >= 0; j++) {
+        int c = binomial(EDGE_COUNT - 1 - j, found + 1);
+        if (x >= c) {
+            x -= c;
+            slice[j] = true;
+            found--;
+        }
+    }
+    int k = 0, other = 0;
+    for (int j = 0; j < EDGE_COUNT; j++) {
+        if (slice[j]) s.setEdge(j, FR + order[k++], 0);
+        else s.setEdge(j, other++, 0);
+    }
+}
+
+inline int cornerPermOf(const CubeState &s) {
+    int p[CORNER_COUNT];
+    for (int i = 0; i < CORNER_COUNT; i++) p[i] = s.corner(i);
+    return permutationRank(p, CORNER_COUNT);
+}
+
+inline void setCornerPerm(CubeState &s, int cornerPerm) {
+    int p[CORNER_COUNT];
+    permutationUnrank(cornerPerm, p, CORNER_COUNT);
+    for (int i = 0; i < CORNER_COUNT; i++) s.setCorner(i, p[i], 0);
+}
+
+inline int udEdgePermOf(const CubeState &s) {
+    int p[8];
+    for (int i = 0; i < 8; i++) p[i] = s.edge(i);
+    return permutationRank(p, 8);
+}
+
+inline void setUdEdgePerm(CubeState &s, int udEdgePerm) {
+    int p[8];
+    permutationUnrank(udEdgePerm, p, 8);
+    for (int i = 0; i < 8; i++) s.setEdge(i, p[i], 0);
+    for (int i = 8; i < EDGE_COUNT; i++) s.setEdge(i, i, 0);
+}
+
+/*
+ * Coordinate move tables: table[coordinate * MOVE_COUNT + move] is the coordinate after the move. The U and D edge
+ * permutation is only filled for phase 2 moves. All tables are laid out one after the other in a single block of
+ * entries(), built here or attached from a table file.
+ */
+struct CoordinateMoves {
+    const uint16_t *twist = NULL;
+    const uint16_t *flip = NULL;
+    const uint16_t *sliceSorted = NULL;
+    const uint16_t *slice = NULL;
+    const uint16_t *cornerPerm = NULL;
+    const uint16_t *udEdgePerm = NULL;
+
+    static size_t entries() {
+        return (size_t) (TWIST_COUNT + FLIP_COUNT + SLICE_SORTED_COUNT + SLICE_COUNT + CORNER_PERM_COUNT
+                         + UD_EDGE_PERM_COUNT) * MOVE_COUNT;
+    }
+
+    /*
+     * Build on `threads` threads (0 for all cores), each filling a contiguous share of every table.
+     */
+    void build(int threads = 0) {
+        if (threads <= 0) threads = (int) std::max(1u, std::thread::hardware_concurrency());
+        storage.assign(entries(), 0);
+        attach(storage.data());
+        uint16_t *base = storage.data();
+
+        auto work = [this, base, threads](int part) {
+            fill(base + (twist - block), TWIST_COUNT, setTwist, twistOf, false, part, threads);
+            fill(base + (flip - block), FLIP_COUNT, setFlip, flipOf, false, part, threads);
+            fill(base + (sliceSorted - block), SLICE_SORTED_COUNT, setSliceSorted, sliceSortedOf, false, part, threads);
+            fill(base + (cornerPerm - block), CORNER_PERM_COUNT, setCornerPerm, cornerPermOf, false, part, threads);
+            fill(base + (udEdgePerm - block), UD_EDGE_PERM_COUNT, setUdEdgePerm, udEdgePermOf, true, part, threads);
+        };
+        std::vector<std::thread> workers;
+        for (int part = 1; part < threads; part++) workers.push_back(std::thread(work, part));
+        work(0);
+        for (std::thread &w : workers) w.join();
+
+        uint16_t *sliceTable = base + (slice - block);
+        for (int x = 0; x < SLICE_COUNT; x++)
+            for (int m = 0; m < MOVE_COUNT; m++)
+                sliceTable[x * MOVE_COUNT + m] =
+                        (uint16_t) (sliceSorted[x * SLICE_PERM_COUNT * MOVE_COUNT + m] / SLICE_PERM_COUNT);
+    }
+
+    void attach(const uint16_t *data) {
+        block = data;
+        twist = block;
+        flip = twist + TWIST_COUNT * MOVE_COUNT;
+        sliceSorted = flip + FLIP_COUNT * MOVE_COUNT;
+        slice = sliceSorted + SLICE_SORTED_COUNT * MOVE_COUNT;
+        cornerPerm = slice + SLICE_COUNT * MOVE_COUNT;
+        udEdgePerm = cornerPerm + CORNER_PERM_COUNT * MOVE_COUNT;
+        if (data != storage.data()) {
+            storage.clear();
+            storage.shrink_to_fit();
+        }
+    }
+
+    const uint16_t *data() const { return block; }
+
+private:
+    template<typename Set, typename Get>
+    static void fill(uint16_t *table, int count, Set set, Get get, bool phase2Only, int part, int parts) {
+        int end = (int) ((long) count * (part + 1) / parts);
+        for (int x = (int) ((long) count * part / parts); x < end; x++) {
+            CubeState s = CubeState::solved();
+            set(s, x);
+            for (int m = 0; m < MOVE_COUNT; m++) {
+                if (phase2Only && !isPhase2Move(m)) continue;
+                table[(size_t) x * MOVE_COUNT + m] = (uint16_t) get(s.move(m));
+            }
+        }
+    }
+
+    std::vector<uint16_t> storage;
+    const uint16_t *block = NULL;
+};
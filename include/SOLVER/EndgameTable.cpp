@@ -0,0 +1,214 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <CUBE/CubeState.cpp>
+#include <SOLVER/TableFile.cpp>
+#include <UTIL/HugePageBuffer.cpp>
+
+/*
+ * Every cube within depth() moves of solved with its distance, so that these cubes are solved by lookups alone: from
+ * a cube at distance d some move leads to one at d - 1, down to solved, and the moves found that way are an optimal
+ * solution.
+ *
+ * The cubes are kept in an open-addressing hash table of 16-byte slots probed linearly, a power of two of them and at
+ * most three quarters full. A slot is a CubeState with the distance in the four bits above the edges; an empty slot
+ * has all corners 0, which no cube has. The depth follows from a memory budget: each move deeper takes about 13 times
+ * the memory, 16 MB hold depth 5 and 256 MB depth 6.
+ */
+class EndgameTable {
+public:
+    // bump when the slot layout or the hash changes: existing files are then regenerated
+    static const uint32_t TABLE_VERSION = 1;
+    static const int MAX_DEPTH = 7;
+
+    /*
+     * Cubes within 0 to 7 moves of solved, in the half turn metric.
+     */
+    static constexpr uint64_t CUBES_WITHIN[MAX_DEPTH + 1] = {1, 19, 262, 3502, 46741, 621649, 8240087, 109043123};
+
+    static size_t slotsFor(int depth) {
+        size_t slots = 1;
+        while (slots * 3 < CUBES_WITHIN[depth] * 4) slots <<= 1;
+        return slots;
+    }
+
+    static size_t bytesFor(int depth) { return slotsFor(depth) * sizeof(CubeState); }
+
+    /*
+     * Deepest table within `budget` bytes, 0 when not even depth 1 fits.
+     */
+    static int depthFor(size_t budget) {
+        int depth = 0;
+        while (depth < MAX_DEPTH && bytesFor(depth + 1) <= budget) depth++;
+        return depth;
+    }
+
+    bool ready() const { return slots != NULL; }
+    int depth() const { return maxDepth; }
+    size_t bytes() const { return slots ? (mask + 1) * sizeof(CubeState) : 0; }
+    const unsigned char *data() const { return (const unsigned char *) slots; }
+    HugePageBuffer::Backing pages() const { return storage.pages(); }
+
+    /*
+     * Breadth-first from solved, one level per move up to `depth`.
+     */
+    void build(int depth) {
+        file.close();
+        size_t count = slotsFor(depth);
+        if (!storage.allocate(count * sizeof(CubeState))) {
+            std::cerr << "ERROR! Unable to allocate an endgame table of " << count << " slots\n";
+            std::exit(1);
+        }
+        slots = (const CubeState *) storage.data();
+        mask = count - 1;
+        maxDepth = depth;
+
+        std::vector<CubeState> frontier = {CubeState::solved()}, next;
+        insert(frontier[0], 0);
+        for (int d = 1; d <= depth; d++) {
+            next.clear();
+            for (const CubeState &s : frontier) {
+                for (int m = 0; m < MOVE_COUNT; m++) {
+                    CubeState n = s.move(m);
+                    if (insert(n, d)) next.push_back(n);
+                }
+            }
+            frontier.swap(next);
+        }
+    }
+
+    /*
+     * Use the table of a file written by save(), if it has `depth`. Returns false, with the reason in `problem`, if
+     * it cannot be used.
+     */
+    bool load(const std::string &path, int depth, const TableLoadOptions &options, const char **problem) {
+        if (!file.open(path, "endgame", TABLE_VERSION, options, problem)) return false;
+        const unsigned char *info = file.section("depth", sizeof(uint64_t));
+        uint64_t fileDepth = 0;
+        if (info) std::memcpy(&fileDepth, info, sizeof(fileDepth));
+        const unsigned char *data = file.section("slots", bytesFor(depth));
+        if (!info || (int) fileDepth != depth || !data) {
+            *problem = "of another depth";
+            file.close();
+            return false;
+        }
+
+        size_t count = slotsFor(depth);
+        if (options.hugePages && storage.allocate(count * sizeof(CubeState))) {
+            std::memcpy(storage.data(), data, count * sizeof(CubeState));
+            slots = (const CubeState *) storage.data();
+            // the copy is all that is read from now on
+            file.close();
+        } else {
+            storage.release();
+            slots = (const CubeState *) data;
+        }
+        mask = count - 1;
+        maxDepth = depth;
+        return true;
+    }
+
+    bool save(const std::string &path) const {
+        uint64_t fileDepth = (uint64_t) maxDepth;
+        std::vector<TableFile::Section> sections = {{"depth", &fileDepth, sizeof(fileDepth)},
+                                                    {"slots", slots, bytes()}};
+        return TableFile::write(path, "endgame", TABLE_VERSION, sections);
+    }
+
+    /*
+     * Map the table of `depth` from `path`, or build it and write the file when it is missing, damaged, from another
+     * version or of another depth. An empty path always builds.
+     */
+    void loadOrBuild(const std::string &path, int depth, const TableLoadOptions &options) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const char *problem = "no table file";
+        if (!path.empty() && load(path, depth, options, &problem)) {
+            std::cout << "[endgame] depth " << depth << " table mapped from " << path << " in " << elapsedMs(start)
+                      << " ms" << std::endl;
+            return;
+        }
+
+        std::cout << "[endgame] " << (path.empty() ? "no table file" : path + ": " + problem)
+                  << ", building the depth " << depth << " table" << std::endl;
+        build(depth);
+        std::cout << "[endgame] " << CUBES_WITHIN[depth] << " cubes, " << bytes() / 1e6 << " MB, built in "
+                  << elapsedMs(start) << " ms" << std::endl;
+        if (!path.empty() && save(path)) {
+            std::cout << "[endgame] table written to " << path << std::endl;
+        }
+    }
+
+    /*
+     * Moves from `c` to solved, or -1 when it is further than depth() away.
+     */
+    int distance(const CubeState &c) const {
+        if (!slots) return -1;
+        for (size_t i = hash(c) & mask;; i = (i + 1) & mask) {
+            const CubeState &slot = slots[i];
+            if (slot.corners == 0) return -1;
+            if (slot.corners == c.corners && (slot.edges & EDGE_BITS) == c.edges) return (int) (slot.edges >> 60);
+        }
+    }
+
+    /*
+     * An optimal solution of `c`, if it is within depth() moves of solved.
+     */
+    bool solve(const CubeState &c, std::vector<int> &moves) const {
+        int d = distance(c);
+        if (d < 0) return false;
+        moves.clear();
+        CubeState s = c;
+        while (d > 0) {
+            for (int m = 0; m < MOVE_COUNT; m++) {
+                CubeState n = s.move(m);
+                if (distance(n) == d - 1) {
+                    moves.push_back(m);
+                    s = n;
+                    break;
+                }
+            }
+            d--;
+        }
+        return true;
+    }
+
+private:
+    static const uint64_t EDGE_BITS = ((uint64_t) 1 << (5 * EDGE_COUNT)) - 1;
+
+    static double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static size_t hash(const CubeState &c) {
+        uint64_t h = c.corners * 0x9e3779b97f4a7c15ULL ^ c.edges * 0xc2b2ae3d27d4eb4fULL;
+        return (size_t) (h ^ h >> 31);
+    }
+
+    /*
+     * Add c at distance d unless it is in the table already.
+     */
+    bool insert(const CubeState &c, int d) {
+        CubeState *table = (CubeState *) storage.data();
+        for (size_t i = hash(c) & mask;; i = (i + 1) & mask) {
+            CubeState &slot = table[i];
+            if (slot.corners == 0) {
+                slot.corners = c.corners;
+                slot.edges = c.edges | (uint64_t) d << 60;
+                return true;
+            }
+            if (slot.corners == c.corners && (slot.edges & EDGE_BITS) == c.edges) return false;
+        }
+    }
+
+    HugePageBuffer storage;
+    TableFile file;
+    const CubeState *slots = NULL;  // storage or the mapped file
+    size_t mask = 0;                // slots - 1
+    int maxDepth = 0;
+};
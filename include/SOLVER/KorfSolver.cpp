@@ -0,0 +1,550 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CUBE/CubeState.cpp>
+#include <SOLVER/Coordinates.cpp>
+#include <SOLVER/EndgameTable.cpp>
+#include <SOLVER/PruningTable.cpp>
+#include <SOLVER/Solution.cpp>
+#include <SOLVER/SymmetryCoordinates.cpp>
+#include <SOLVER/TableFile.cpp>
+#include <UTIL/WorkStealingPool.cpp>
+
+/*
+ * Raw index of the corners: permutation and twist, 8! * 3^7 values. The database itself is indexed by the
+ * symmetry-reduced CornerSymmetryCoordinate.
+ */
+inline size_t cornerPatternIndex(const CubeState &s) {
+    return (size_t) cornerPermOf(s) * TWIST_COUNT + twistOf(s);
+}
+
+/*
+ * Index of a group of `pieces` edges, cubies first .. first + pieces - 1, in an edge pattern database: where they
+ * are and how they are flipped, 12!/(12 - pieces)! * 2^pieces values. Slots are counted from `first`, so that the
+ * solved group has index 0.
+ */
+inline size_t edgePatternIndex(const CubeState &s, int first, int pieces) {
+    int position[EDGE_COUNT];
+    int flips = 0;
+    for (int slot = 0; slot < EDGE_COUNT; slot++) {
+        int e = s.edge(slot) - first;
+        if (e < 0) e += EDGE_COUNT;
+        if (e < pieces) {
+            position[e] = (slot - first + EDGE_COUNT) % EDGE_COUNT;
+            flips |= s.edgeFlip(slot) << e;
+        }
+    }
+    return (size_t) partialPermutationRank(position, EDGE_COUNT, pieces) << pieces | flips;
+}
+
+/*
+ * Pattern databases of the optimal solver: the exact number of moves to solve the corners alone, one entry per
+ * symmetry class (6.05 M entries, 3 MB, against 88 M and 44 MB unreduced), and each of two groups of edges alone,
+ * the first and the last `edgePieces` of the twelve (42.6 M entries, 21 MB each, for 6 edges; 511 M entries, 255 MB
+ * each, for 7). The largest of the three never overestimates.
+ *
+ * The edge groups are not mapped onto themselves by the symmetries, so their databases stay unreduced.
+ *
+ * With modulo3 the databases keep the distances modulo 3 in two bits instead of four, half the memory; the search
+ * then carries the exact distances down from the root, where they are found by walking to the goal.
+ */
+class KorfTables {
+public:
+    static const uint32_t TABLE_VERSION = 2;
+    static const int MIN_EDGE_PIECES = 6;
+    static const int MAX_EDGE_PIECES = 7;
+
+    enum Database { CORNERS = 0, EDGES_LOW, EDGES_HIGH, DATABASE_COUNT };
+
+    int edgePieces = MIN_EDGE_PIECES;
+    bool modulo3 = false;
+    CornerSymmetryCoordinate cornerSymmetry;
+    PruningTable exact[DATABASE_COUNT];             // without modulo3
+    ModuloPruningTable residues[DATABASE_COUNT];    // with modulo3
+
+    static size_t edgePositionCount(int pieces) {
+        size_t n = 1;
+        for (int i = 0; i < pieces; i++) n *= (size_t) (EDGE_COUNT - i);
+        return n;
+    }
+
+    static size_t edgeEntries(int pieces) { return edgePositionCount(pieces) << pieces; }
+
+    static size_t entries(int database, int pieces) {
+        return database == CORNERS ? CornerSymmetryCoordinate::INDEX_COUNT : edgeEntries(pieces);
+    }
+
+    bool ready() const { return modulo3 ? !residues[EDGES_HIGH].empty() : !exact[EDGES_HIGH].empty(); }
+
+    size_t bytes() const {
+        size_t total = 0;
+        for (int db = 0; db < DATABASE_COUNT; db++) total += modulo3 ? residues[db].bytes() : exact[db].bytes();
+        return total;
+    }
+
+    size_t index(int database, const CubeState &s) const {
+        if (database == CORNERS) return cornerSymmetry.index(s);
+        return edgePatternIndex(s, database == EDGES_LOW ? 0 : EDGE_COUNT - edgePieces, edgePieces);
+    }
+
+    /*
+     * Distance of entry i of a database, given the distance in the same database of a cube one move away (only
+     * needed with modulo3).
+     */
+    int distance(int database, size_t i, int neighbour) const {
+        return modulo3 ? ModuloPruningTable::distance(neighbour, residues[database].get(i)) : exact[database].get(i);
+    }
+
+    void prefetch(int database, size_t i) const {
+        if (modulo3) residues[database].prefetch(i);
+        else exact[database].prefetch(i);
+    }
+
+    HugePageBuffer::Backing pages() const {
+        return modulo3 ? residues[EDGES_HIGH].pages() : exact[EDGES_HIGH].pages();
+    }
+
+    /*
+     * Distance of s in a database without a neighbour to start from: with modulo3, the number of moves it takes to
+     * reach the goal going down one residue at every step.
+     */
+    int distance(int database, const CubeState &s) const {
+        size_t i = index(database, s);
+        if (!modulo3) return exact[database].get(i);
+        CubeState c = s;
+        int steps = 0;
+        while (i != 0 && steps < PruningTable::UNKNOWN) {
+            int down = (residues[database].get(i) + 2) % 3;
+            for (int m = 0; m < MOVE_COUNT; m++) {
+                size_t j = index(database, c.move(m));
+                if (residues[database].get(j) == down) {
+                    c = c.move(m);
+                    i = j;
+                    break;
+                }
+            }
+            steps++;
+        }
+        return steps;
+    }
+
+    /*
+     * Build the three databases on `threads` threads (0 for all cores). With modulo3 they are built whole, then
+     * compressed.
+     */
+    PruningTable::FillStats build(int pieces, bool modulo, int threads = 0, bool progress = false) {
+        file.close();
+        edgePieces = pieces;
+        modulo3 = modulo;
+        static const int allMoves[MOVE_COUNT] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17};
+        PruningTable::FillStats total, stats;
+
+        CoordinateMoves m;
+        m.build(threads);
+        cornerSymmetry.build();
+        exact[CORNERS].allocate(CornerSymmetryCoordinate::INDEX_COUNT);
+        const CornerSymmetryCoordinate &symmetry = cornerSymmetry;
+        stats = exact[CORNERS].fillBreadthFirst(allMoves, MOVE_COUNT, [&m, &symmetry](size_t i, int move) {
+            return symmetry.next(i, move, m);
+        }, threads, progress ? names[CORNERS] : NULL);
+        accumulate(total, stats);
+
+        int first[DATABASE_COUNT] = {0, 0, EDGE_COUNT - pieces};
+        for (int db = EDGES_LOW; db <= EDGES_HIGH; db++) {
+            std::vector<uint32_t> positionMoves;
+            buildEdgePositionMoves(first[db], pieces, threads, positionMoves);
+            const uint32_t *pm = positionMoves.data();
+            size_t flipMask = ((size_t) 1 << pieces) - 1;
+            exact[db].allocate(edgeEntries(pieces));
+            stats = exact[db].fillBreadthFirst(allMoves, MOVE_COUNT, [pm, pieces, flipMask](size_t i, int move) {
+                uint32_t e = pm[(i >> pieces) * MOVE_COUNT + move];
+                return (size_t) (e & 0xffffff) << pieces | ((i & flipMask) ^ (e >> 24));
+            }, threads, progress ? names[db] : NULL);
+            accumulate(total, stats);
+        }
+
+        for (int db = 0; db < DATABASE_COUNT; db++) {
+            if (modulo3) {
+                residues[db].compress(exact[db]);
+                exact[db] = PruningTable();
+            } else {
+                residues[db] = ModuloPruningTable();
+            }
+        }
+        return total;
+    }
+
+    bool load(const std::string &path, int pieces, bool modulo, const TableLoadOptions &options,
+              const char **problem) {
+        if (!file.open(path, "korf", TABLE_VERSION, options, problem)) return false;
+        const unsigned char *data[DATABASE_COUNT];
+        for (int db = 0; db < DATABASE_COUNT; db++) {
+            size_t n = entries(db, pieces);
+            data[db] = modulo ? file.section(moduloNames[db], ModuloPruningTable::bytesFor(n))
+                              : file.section(names[db], (n + 1) / 2);
+            if (!data[db]) {
+                *problem = "a table is missing or has another size";
+                file.close();
+                return false;
+            }
+        }
+        edgePieces = pieces;
+        modulo3 = modulo;
+        if (!cornerSymmetry.ready()) cornerSymmetry.build();
+        for (int db = 0; db < DATABASE_COUNT; db++) {
+            size_t n = entries(db, pieces);
+            if (modulo3) {
+                if (options.hugePages) residues[db].copy(data[db], n);
+                else residues[db].attach(data[db], n);
+                exact[db] = PruningTable();
+            } else {
+                if (options.hugePages) exact[db].copy(data[db], n);
+                else exact[db].attach(data[db], n);
+                residues[db] = ModuloPruningTable();
+            }
+        }
+        if (options.hugePages) file.close();
+        return true;
+    }
+
+    bool save(const std::string &path) const {
+        std::vector<TableFile::Section> sections;
+        for (int db = 0; db < DATABASE_COUNT; db++) {
+            if (modulo3) sections.push_back({moduloNames[db], residues[db].data(), residues[db].bytes()});
+            else sections.push_back({names[db], exact[db].data(), exact[db].bytes()});
+        }
+        return TableFile::write(path, "korf", TABLE_VERSION, sections);
+    }
+
+    /*
+     * Map the databases from `path`, or build them and write the file when it is missing, damaged, from another
+     * version or for other settings. An empty path always builds.
+     */
+    void loadOrBuild(const std::string &path, int pieces, bool modulo, const TableLoadOptions &options) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const char *problem = "no table file";
+        if (!path.empty() && load(path, pieces, modulo, options, &problem)) {
+            std::cout << "[korf] pattern databases "
+                      << (options.hugePages ? std::string("copied to ") + HugePageBuffer::describe(pages()) : "mapped")
+                      << " from " << path << " in " << elapsedMs(start) << " ms" << std::endl;
+            return;
+        }
+
+        std::cout << "[korf] " << (path.empty() ? "no table file" : path + ": " + problem)
+                  << ", building pattern databases" << std::endl;
+        PruningTable::FillStats stats = build(pieces, modulo);
+        std::cout << "[korf] " << bytes() / 1e6 << " MB built in " << elapsedMs(start) / 1000.0 << " s ("
+                  << stats.states / stats.seconds / 1e6 << " M states/s)" << std::endl;
+        if (!path.empty() && save(path)) {
+            std::cout << "[korf] pattern databases written to " << path << std::endl;
+        }
+    }
+
+private:
+    static double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static void accumulate(PruningTable::FillStats &total, const PruningTable::FillStats &stats) {
+        total.depth = std::max(total.depth, stats.depth);
+        total.states += stats.states;
+        total.seconds += stats.seconds;
+    }
+
+    /*
+     * Move table of the edge positions, only needed while building: for every position rank and move, the new rank
+     * in the low 24 bits and the flips the move adds to the group above them.
+     */
+    static void buildEdgePositionMoves(int first, int pieces, int threads, std::vector<uint32_t> &table) {
+        if (threads <= 0) threads = (int) std::max(1u, std::thread::hardware_concurrency());
+        size_t count = edgePositionCount(pieces);
+        table.assign(count * MOVE_COUNT, 0);
+
+        // slot each slot goes to, and the flip it picks up there
+        int destination[MOVE_COUNT][EDGE_COUNT], flip[MOVE_COUNT][EDGE_COUNT];
+        for (int m = 0; m < MOVE_COUNT; m++) {
+            for (int q = 0; q < EDGE_COUNT; q++) {
+                destination[m][moveTables.moveCube[m].edge(q)] = q;
+                flip[m][q] = moveTables.moveCube[m].edgeFlip(q);
+            }
+        }
+
+        auto work = [&](int part) {
+            size_t end = count * (part + 1) / threads;
+            for (size_t r = count * part / threads; r < end; r++) {
+                int position[EDGE_COUNT], moved[EDGE_COUNT];
+                partialPermutationUnrank((int) r, position, EDGE_COUNT, pieces);
+                for (int m = 0; m < MOVE_COUNT; m++) {
+                    uint32_t flips = 0;
+                    for (int k = 0; k < pieces; k++) {
+                        int q = destination[m][(position[k] + first) % EDGE_COUNT];
+                        moved[k] = (q - first + EDGE_COUNT) % EDGE_COUNT;
+                        flips |= (uint32_t) flip[m][q] << k;
+                    }
+                    uint32_t rank = (uint32_t) partialPermutationRank(moved, EDGE_COUNT, pieces);
+                    table[r * MOVE_COUNT + m] = rank | flips << 24;
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int part = 1; part < threads; part++) workers.push_back(std::thread(work, part));
+        work(0);
+        for (std::thread &w : workers) w.join();
+    }
+
+    static constexpr const char *names[DATABASE_COUNT] = {"corners", "edgesLow", "edgesHigh"};
+    static constexpr const char *moduloNames[DATABASE_COUNT] = {"cornersMod3", "edgesLowMod3", "edgesHighMod3"};
+
+    TableFile file;
+};
+
+/*
+ * Optimal solver (Korf 1997): iterative deepening A* in the half turn metric, bounded by the largest of the three
+ * pattern database distances. Every bound is searched completely before the next, so the first solution found is
+ * as short as possible. Nodes are CubeStates, their database indexes are computed from the state at every node;
+ * every generated node counts, pruned or not. Each node carries its three database distances, from which those of
+ * its children follow when the databases only hold residues.
+ *
+ * With several threads each bound is split at SPLIT_DEPTH moves into one subtree per move sequence that survives
+ * pruning, and the subtrees are searched on a work-stealing pool. All subtrees of a bound finish before the next
+ * bound starts, and the first solution found, or the timeout, cancels the remaining ones.
+ *
+ * A solver runs one solve at a time.
+ */
+class KorfSolver {
+public:
+    explicit KorfSolver(const KorfTables &tables) : t(tables) {}
+
+    /*
+     * Returns false when the cube is not solvable, or no solution of at most options.maxLength moves was found
+     * within options.timeoutMs or before options.cancel was cancelled.
+     */
+    bool solve(const CubeState &cube, const SolveOptions &options, Solution &solution) {
+        start = std::chrono::steady_clock::now();
+        solution = Solution();
+        if (cube.verify() != NULL) return false;
+        if (options.endgame && options.endgame->solve(cube, solution.moves)) {
+            solution.found = true;
+            solution.solveMs = elapsedMs();
+            if (options.improved) options.improved(solution);
+            return true;
+        }
+
+        int threads = options.threads > 0 ? options.threads : (int) std::max(1u, std::thread::hardware_concurrency());
+        if (threads > 1 && (!pool || pool->threads() != threads)) pool.reset(new WorkStealingPool(threads));
+        searches.assign(threads, Search());
+        timeoutMs = options.timeoutMs;
+        cancel = options.cancel;
+        cancelled = false;
+        timedOut = false;
+        stoppedByToken = false;
+        found = false;
+        splitNodes = 0;
+        Distances root = distances(cube);
+        int first = *std::max_element(root.begin(), root.end());
+        for (int bound = first; bound <= options.maxLength && bound <= MAX_SEARCH_LENGTH && !cancelled; bound++) {
+            if (threads == 1 || bound <= SPLIT_DEPTH) {
+                Search &w = searches[0];
+                if (search(w, cube, root, 0, bound)) finish(w.path, bound);
+            } else {
+                int prefix[SPLIT_DEPTH];
+                split(cube, root, prefix, 0, bound);
+                pool->wait();
+            }
+        }
+
+        solution.found = found;
+        solution.timedOut = timedOut && !found;
+        solution.cancelled = stoppedByToken && !found;
+        if (found) solution.moves = best;
+        for (const Search &w : searches) solution.nodes += w.nodes;
+        solution.nodes += splitNodes;
+        solution.solveMs = elapsedMs();
+        return found;
+    }
+
+    /*
+     * Lower bound of the distance to solved.
+     */
+    int distance(const CubeState &s) const {
+        Distances d = distances(s);
+        return *std::max_element(d.begin(), d.end());
+    }
+
+private:
+    typedef std::array<int, KorfTables::DATABASE_COUNT> Distances;
+
+    static const int MAX_SEARCH_LENGTH = 26;
+    static const int SPLIT_DEPTH = 3;           // up to 18 * 15 * 15 subtrees per bound
+    static const long TIMEOUT_CHECK_NODES = 1 << 14;
+
+    /*
+     * State of one thread's search, on its own cache lines.
+     */
+    struct alignas(64) Search {
+        int path[MAX_SEARCH_LENGTH + 1];
+        long nodes = 0;
+        long nextCheck = TIMEOUT_CHECK_NODES;
+    };
+
+    struct Child {
+        CubeState state;
+        size_t index[KorfTables::DATABASE_COUNT];
+        Distances distance;
+        int move;
+    };
+
+    double elapsedMs() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static bool redundant(int move, const int *path, int depth) {
+        if (depth == 0) return false;
+        // same face twice, or two opposite faces in the other order
+        int face = moveFace(move), last = moveFace(path[depth - 1]);
+        return face == last || face + 3 == last;
+    }
+
+    Distances distances(const CubeState &s) const {
+        Distances d;
+        for (int db = 0; db < KorfTables::DATABASE_COUNT; db++) d[db] = t.distance(db, s);
+        return d;
+    }
+
+    /*
+     * Whether no database puts s, a child of a cube at distances `parent`, further than `limit` moves away; its
+     * distances go to `d`. The corner index is cheapest and prunes most often, so the edge indexes are only computed
+     * when it passes.
+     */
+    bool withinBound(const CubeState &s, const Distances &parent, int limit, Distances &d) const {
+        for (int db = 0; db < KorfTables::DATABASE_COUNT; db++) {
+            d[db] = t.distance(db, t.index(db, s), parent[db]);
+            if (d[db] > limit) return false;
+        }
+        return true;
+    }
+
+    /*
+     * Record a solution of `length` moves and cancel the rest of the search. Only the first one is kept; all have
+     * the same length.
+     */
+    void finish(const int *path, int length) {
+        std::lock_guard<std::mutex> lock(bestLock);
+        if (!found) {
+            best.assign(path, path + length);
+            found = true;
+        }
+        cancelled = true;
+    }
+
+    /*
+     * Walk the first SPLIT_DEPTH moves of bound `bound` and hand every surviving subtree to the pool.
+     */
+    void split(const CubeState &s, const Distances &d, int *prefix, int depth, int bound) {
+        if (cancelled) return;
+        if (depth == SPLIT_DEPTH) {
+            std::array<int, SPLIT_DEPTH> moves;
+            std::copy(prefix, prefix + SPLIT_DEPTH, moves.begin());
+            pool->submit([this, s, d, moves, bound](int worker) {
+                Search &w = searches[worker];
+                std::copy(moves.begin(), moves.end(), w.path);
+                if (search(w, s, d, SPLIT_DEPTH, bound - SPLIT_DEPTH)) finish(w.path, bound);
+            });
+            return;
+        }
+        for (int m = 0; m < MOVE_COUNT; m++) {
+            if (redundant(m, prefix, depth)) continue;
+            CubeState next = s.move(m);
+            Distances nd;
+            splitNodes++;
+            if (!withinBound(next, d, bound - depth - 1, nd)) continue;
+            prefix[depth] = m;
+            split(next, nd, prefix, depth + 1, bound);
+        }
+    }
+
+    bool search(Search &w, const CubeState &s, const Distances &d, int depth, int togo) {
+        if (togo == 0) return s.isSolved();
+        if (w.nodes >= w.nextCheck) {
+            w.nextCheck = w.nodes + TIMEOUT_CHECK_NODES;
+            if (cancel.cancelled()) {
+                stoppedByToken = true;
+                cancelled = true;
+            } else if (elapsedMs() > timeoutMs) {
+                timedOut = true;
+                cancelled = true;
+            }
+        }
+        if (cancelled.load(std::memory_order_relaxed)) return false;
+
+        // The children go through the databases together, so that their reads overlap instead of waiting for one
+        // another: all corner indexes, then the edge indexes of the children the corners keep, then the edge
+        // distances. Each pass prefetches the entries the next one reads.
+        Child children[MOVE_COUNT];
+        int n = 0, limit = togo - 1;
+        for (int m = 0; m < MOVE_COUNT; m++) {
+            if (redundant(m, w.path, depth)) continue;
+            Child &c = children[n++];
+            c.move = m;
+            c.state = s.move(m);
+            c.index[KorfTables::CORNERS] = t.index(KorfTables::CORNERS, c.state);
+            t.prefetch(KorfTables::CORNERS, c.index[KorfTables::CORNERS]);
+        }
+        w.nodes += n;
+
+        int kept = 0;
+        for (int k = 0; k < n; k++) {
+            Child &c = children[k];
+            c.distance[KorfTables::CORNERS] = t.distance(KorfTables::CORNERS, c.index[KorfTables::CORNERS],
+                                                         d[KorfTables::CORNERS]);
+            if (c.distance[KorfTables::CORNERS] > limit) continue;
+            for (int db = KorfTables::EDGES_LOW; db <= KorfTables::EDGES_HIGH; db++) {
+                c.index[db] = t.index(db, c.state);
+                t.prefetch(db, c.index[db]);
+            }
+            children[kept++] = c;
+        }
+
+        int open = 0;
+        for (int k = 0; k < kept; k++) {
+            Child &c = children[k];
+            bool within = true;
+            for (int db = KorfTables::EDGES_LOW; db <= KorfTables::EDGES_HIGH; db++) {
+                c.distance[db] = t.distance(db, c.index[db], d[db]);
+                within = within && c.distance[db] <= limit;
+            }
+            if (within) children[open++] = c;
+        }
+
+        for (int k = 0; k < open; k++) {
+            w.path[depth] = children[k].move;
+            if (search(w, children[k].state, children[k].distance, depth + 1, limit)) return true;
+        }
+        return false;
+    }
+
+    const KorfTables &t;
+    std::unique_ptr<WorkStealingPool> pool;
+    std::vector<Search> searches;               // one per thread
+    long splitNodes = 0;
+    std::chrono::steady_clock::time_point start;
+    double timeoutMs = 0.0;
+    CancellationToken cancel;
+    std::atomic<bool> cancelled{false};         // solved, timed out or stopped through the token
+    std::atomic<bool> timedOut{false};
+    std::atomic<bool> stoppedByToken{false};
+    std::mutex bestLock;
+    bool found = false;
+    std::vector<int> best;
+};
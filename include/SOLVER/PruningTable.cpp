@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <UTIL/HugePageBuffer.cpp>
+
+/*
+ * Distance to the goal for every value of a (combined) coordinate, four bits per entry, two entries per byte.
+ * Entries not reached yet read UNKNOWN. The entries live either in the table's own storage, on huge pages where the
+ * system has them, or in memory attached read-only, typically a mapped table file.
+ */
+class PruningTable {
+public:
+    static const int UNKNOWN = 15;
+
+    void allocate(size_t entries) {
+        count = 0;
+        table = NULL;
+        if (!storage.allocate((entries + 1) / 2)) {
+            std::cerr << "ERROR! Unable to allocate a pruning table of " << entries << " entries\n";
+            return;
+        }
+        count = entries;
+        std::memset(storage.data(), 0xff, bytes());
+        table = storage.data();
+    }
+
+    void attach(const unsigned char *data, size_t entries) {
+        storage.release();
+        count = entries;
+        table = data;
+    }
+
+    /*
+     * Own copy of entries read from elsewhere, e.g. a mapped file on ordinary pages.
+     */
+    void copy(const unsigned char *data, size_t entries) {
+        allocate(entries);
+        if (count) std::memcpy(storage.data(), data, bytes());
+    }
+
+    int get(size_t i) const { return (table[i >> 1] >> ((i & 1) << 2)) & 15; }
+
+    /*
+     * Start loading the cache line of entry i, to be read a little later.
+     */
+    void prefetch(size_t i) const { __builtin_prefetch(table + (i >> 1)); }
+
+    void set(size_t i, int distance) {
+        int shift = (int) (i & 1) << 2;
+        uint8_t *byte = storage.data() + (i >> 1);
+        *byte = (uint8_t) ((*byte & ~(15 << shift)) | distance << shift);
+    }
+
+    const unsigned char *data() const { return table; }
+    HugePageBuffer::Backing pages() const { return storage.pages(); }
+    size_t entries() const { return count; }
+    size_t bytes() const { return (count + 1) / 2; }
+    bool empty() const { return count == 0; }
+
+    struct FillStats {
+        int depth = 0;          // largest distance
+        size_t states = 0;      // entries reached
+        double seconds = 0.0;
+    };
+
+    /*
+     * Fill by breadth first search from entry 0, the goal. next(i, move) is the entry reached from i by the move;
+     * the moves must include their inverses. Early levels expand forward from the entries at the current distance;
+     * once most of the table is known it is cheaper to go backward, from every unknown entry looking for a neighbour
+     * at the current distance.
+     *
+     * Each level is spread over `threads` threads (0 for all cores) taking chunks of entries in turn, and finished by
+     * all of them before the next one starts. Entries are claimed with a compare-and-swap on their byte; every thread
+     * that claims an entry in a level writes the same distance, so the table is the same for any number of threads.
+     * With a progress name every level is reported.
+     */
+    template<typename Next>
+    FillStats fillBreadthFirst(const int *moves, int moveCount, Next next, int threads = 0,
+                               const char *progressName = NULL) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (threads <= 0) threads = (int) std::max(1u, std::thread::hardware_concurrency());
+
+        std::memset(storage.data(), 0xff, bytes());
+        set(0, 0);
+        FillStats stats;
+        stats.states = 1;
+        int depth = 0;
+        while (stats.states < count && depth < UNKNOWN - 1) {
+            bool backward = stats.states > count / 2;
+            std::atomic<size_t> nextChunk(0);
+            std::atomic<size_t> added(0);
+            auto expand = [&]() {
+                size_t local = 0;
+                for (;;) {
+                    size_t begin = nextChunk.fetch_add(FILL_CHUNK);
+                    if (begin >= count) break;
+                    size_t end = std::min(begin + FILL_CHUNK, count);
+                    for (size_t i = begin; i < end; i++) {
+                        if (backward) {
+                            if (load(i) != UNKNOWN) continue;
+                            for (int k = 0; k < moveCount; k++) {
+                                if (load(next(i, moves[k])) == depth) {
+                                    if (claim(i, depth + 1)) local++;
+                                    break;
+                                }
+                            }
+                        } else {
+                            if (load(i) != depth) continue;
+                            for (int k = 0; k < moveCount; k++) {
+                                if (claim(next(i, moves[k]), depth + 1)) local++;
+                            }
+                        }
+                    }
+                }
+                added += local;
+            };
+
+            if (threads == 1) {
+                expand();
+            } else {
+                std::vector<std::thread> workers;
+                for (int t = 0; t < threads; t++) workers.push_back(std::thread(expand));
+                for (std::thread &w : workers) w.join();
+            }
+            if (added == 0) break;
+            stats.states += added;
+            depth++;
+
+            if (progressName) {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << "[tables] " << progressName << " depth " << depth << (backward ? " (backward)" : "")
+                          << ": " << added << " states, " << 100.0 * stats.states / count << "% done, "
+                          << stats.states / seconds / 1e6 << " M states/s" << std::endl;
+            }
+        }
+        stats.depth = depth;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+private:
+    static const size_t FILL_CHUNK = 1 << 14;   // even, so both entries of a byte are in the same chunk
+
+    int load(size_t i) const {
+        return (__atomic_load_n(storage.data() + (i >> 1), __ATOMIC_RELAXED) >> ((i & 1) << 2)) & 15;
+    }
+
+    /*
+     * Set an UNKNOWN entry. Returns false if it already has a distance.
+     */
+    bool claim(size_t i, int distance) {
+        uint8_t *byte = storage.data() + (i >> 1);
+        int shift = (int) (i & 1) << 2;
+        uint8_t old = __atomic_load_n(byte, __ATOMIC_RELAXED);
+        for (;;) {
+            if (((old >> shift) & 15) != UNKNOWN) return false;
+            uint8_t value = (uint8_t) ((old & ~(15 << shift)) | distance << shift);
+            if (__atomic_compare_exchange_n(byte, &old, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return true;
+        }
+    }
+
+    HugePageBuffer storage;
+    const uint8_t *table = NULL;
+    size_t count = 0;
+};
+
+/*
+ * Distances modulo 3, two bits per entry, four entries per byte: half the memory of a PruningTable. Along a move
+ * the distance changes by at most one, so a search that knows the exact distance of a cube recovers those of its
+ * neighbours from their residues. Entries a PruningTable leaves UNKNOWN read 3.
+ */
+class ModuloPruningTable {
+public:
+    static const int UNKNOWN = 3;
+
+    void compress(const PruningTable &exact) {
+        count = 0;
+        table = NULL;
+        if (!storage.allocate(bytesFor(exact.entries()))) {
+            std::cerr << "ERROR! Unable to allocate a pruning table of " << exact.entries() << " entries\n";
+            return;
+        }
+        count = exact.entries();
+        uint8_t *out = storage.data();
+        for (size_t i = 0; i < count; i++) {
+            int d = exact.get(i);
+            out[i >> 2] |= (uint8_t) ((d == PruningTable::UNKNOWN ? UNKNOWN : d % 3) << ((i & 3) << 1));
+        }
+        table = out;
+    }
+
+    void attach(const unsigned char *data, size_t entries) {
+        storage.release();
+        count = entries;
+        table = data;
+    }
+
+    void copy(const unsigned char *data, size_t entries) {
+        count = 0;
+        table = NULL;
+        if (!storage.allocate(bytesFor(entries))) {
+            std::cerr << "ERROR! Unable to allocate a pruning table of " << entries << " entries\n";
+            return;
+        }
+        count = entries;
+        std::memcpy(storage.data(), data, bytes());
+        table = storage.data();
+    }
+
+    int get(size_t i) const { return (table[i >> 2] >> ((i & 3) << 1)) & 3; }
+
+    void prefetch(size_t i) const { __builtin_prefetch(table + (i >> 2)); }
+
+    /*
+     * Exact distance of an entry with residue `residue`, one move away from an entry at distance `neighbour`.
+     */
+    static int distance(int neighbour, int residue) { return neighbour - 1 + (residue - neighbour % 3 + 4) % 3; }
+
+    static size_t bytesFor(size_t entries) { return (entries + 3) / 4; }
+
+    const unsigned char *data() const { return table; }
+    size_t entries() const { return count; }
+    size_t bytes() const { return bytesFor(count); }
+    bool empty() const { return count == 0; }
+    HugePageBuffer::Backing pages() const { return storage.pages(); }
+
+private:
+    HugePageBuffer storage;
+    const uint8_t *table = NULL;
+    size_t count = 0;
+};
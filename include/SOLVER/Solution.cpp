@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*
+ * Stops a solve from another thread. Copies share one flag, so the caller keeps a copy of the token it put in the
+ * SolveOptions and cancels it whenever the result is no longer wanted; the solver then returns within a few thousand
+ * nodes with what it has found so far.
+ */
+class CancellationToken {
+public:
+    CancellationToken() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const { flag->store(true); }
+    bool cancelled() const { return flag->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+class EndgameTable;
+
+/*
+ * Result of a solve. timedOut and cancelled tell that the deadline, or the cancellation token, stopped the solve
+ * before it reached its goal: a solution of at most maxLength moves for the two-phase solver, an optimal one for
+ * Korf's. found may still be set then, the two-phase solver returning the shortest solution it had so far.
+ */
+struct Solution {
+    std::vector<int> moves;
+    bool found = false;
+    bool timedOut = false;
+    bool cancelled = false;
+    double solveMs = 0.0;
+    long nodes = 0;             // search nodes visited
+
+    double nodesPerSecond() const { return solveMs > 0.0 ? nodes / solveMs * 1000.0 : 0.0; }
+};
+
+/*
+ * Budget of a solve, shared by the solvers.
+ *
+ * The two-phase solver is an anytime search: it finds a first solution almost at once and shorter ones the longer it
+ * runs, until one is at most maxLength moves long or timeoutMs has passed. Each of them is passed to `improved` as
+ * it is found, on a solving thread and one at a time, with solveMs and the nodes of its search as of that moment, so
+ * that a caller can show the best solution so far without waiting for the solve to return.
+ *
+ * By default the cube is searched in all six orientations at once, each on a thread of the solver's own. One
+ * orientation alone reaches 20 moves in milliseconds for most cubes but takes seconds for a few percent of them; of
+ * six, one nearly always gets there quickly and all stop then, so a solve costs less CPU time in total than a single
+ * search does, at the price of six threads while it runs.
+ */
+struct SolveOptions {
+    int maxLength = 20;         // stop at the first solution this short
+    double timeoutMs = 1000.0;  // then return the shortest solution found so far, if any
+    int threads = 1;            // search threads of the optimal solver, 0 for one per core
+    int orientations = 6;       // concurrent two-phase searches, up to 6: three axes, each also inverted
+    std::function<void(const Solution &)> improved;    // every shorter solution found, may be empty
+    CancellationToken cancel;
+    const EndgameTable *endgame = NULL;    // cubes this near solved are answered by lookup, optimally
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <CUBE/CubeState.cpp>
+#include <CUBE/Symmetry.cpp>
+#include <SOLVER/TableFile.cpp>
+
+/*
+ * Best known solutions of recently solved cubes, shared by any number of threads.
+ *
+ * A cube is stored under its canonical form: the smallest, by its two words, of the cube and its inverse seen through
+ * each of the 48 symmetries. All 96 of these are as far from solved, so a rescan of the same cube held another way up,
+ * mirrored or inverted finds the entry, and its moves are carried back to the cube asked for. An entry keeps the
+ * shortest solution inserted for it.
+ *
+ * The cache holds at most `capacity` cubes, split over SHARD_COUNT shards with a lock each; a full shard evicts its
+ * least recently used cube. It can be written to a file and read back, in the table file format.
+ */
+class SolutionCache {
+public:
+    static const uint32_t FILE_VERSION = 1;
+    static const int MAX_MOVES = 31;
+
+    struct Stats {
+        long hits = 0;
+        long misses = 0;
+        long insertions = 0;    // new cubes and shorter solutions of cached ones
+        long evictions = 0;
+        size_t entries = 0;
+    };
+
+    explicit SolutionCache(size_t capacity = 1 << 16) {
+        shardCapacity = std::max<size_t>(1, (capacity + SHARD_COUNT - 1) / SHARD_COUNT);
+    }
+
+    SolutionCache(const SolutionCache &) = delete;
+    SolutionCache &operator=(const SolutionCache &) = delete;
+
+    /*
+     * Moves solving `cube`, if it or one of its symmetric or inverse cubes is cached.
+     */
+    bool find(const CubeState &cube, std::vector<int> &moves) {
+        Canonical c = canonical(cube);
+        Shard &shard = shardOf(c.state);
+        {
+            std::lock_guard<std::mutex> lock(shard.lock);
+            auto it = shard.index.find(c.state);
+            if (it == shard.index.end()) {
+                misses++;
+                return false;
+            }
+            shard.recent.splice(shard.recent.begin(), shard.recent, it->second);
+            moves = it->second->moves;
+        }
+        hits++;
+        moves = conjugateMoves(moves, symmetryTables.inverse[c.symmetry]);
+        if (c.inverted) moves = inverseMoves(moves);
+        return true;
+    }
+
+    /*
+     * Remember moves solving `cube`, unless a solution at least as short is cached already.
+     */
+    void insert(const CubeState &cube, const std::vector<int> &moves) {
+        if ((int) moves.size() > MAX_MOVES) return;
+        Canonical c = canonical(cube);
+        std::vector<int> stored = conjugateMoves(c.inverted ? inverseMoves(moves) : moves, c.symmetry);
+        store(c.state, stored);
+    }
+
+    Stats stats() {
+        Stats s;
+        s.hits = hits;
+        s.misses = misses;
+        s.insertions = insertions;
+        s.evictions = evictions;
+        for (Shard &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.lock);
+            s.entries += shard.index.size();
+        }
+        return s;
+    }
+
+    /*
+     * Add the cubes of a file written by save(), as far as they fit. Returns false, with the reason in `problem`, if
+     * it cannot be used.
+     */
+    bool load(const std::string &path, const char **problem) {
+        TableFile file;
+        if (!file.open(path, "solutions", FILE_VERSION, TableLoadOptions(), problem)) return false;
+        const unsigned char *countData = file.section("count", sizeof(uint64_t));
+        uint64_t count = 0;
+        if (countData) std::memcpy(&count, countData, sizeof(count));
+        const unsigned char *data = file.section("entries", count * sizeof(Record));
+        if (!countData || !data) {
+            *problem = "a table is missing";
+            return false;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            Record r;
+            std::memcpy(&r, data + i * sizeof(Record), sizeof(Record));
+            CubeState state;
+            state.corners = r.corners;
+            state.edges = r.edges;
+            if (r.length > MAX_MOVES || state.verify() != NULL) continue;
+            store(state, std::vector<int>(r.moves, r.moves + r.length));
+        }
+        return true;
+    }
+
+    /*
+     * Write every cached cube, least recently used first so that a smaller cache reading the file keeps the newest.
+     */
+    bool save(const std::string &path) {
+        std::vector<Record> records;
+        for (Shard &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.lock);
+            for (auto it = shard.recent.rbegin(); it != shard.recent.rend(); ++it) {
+                Record r;
+                std::memset(&r, 0, sizeof(r));
+                r.corners = it->state.corners;
+                r.edges = it->state.edges;
+                r.length = (uint8_t) it->moves.size();
+                for (size_t i = 0; i < it->moves.size(); i++) r.moves[i] = (uint8_t) it->moves[i];
+                records.push_back(r);
+            }
+        }
+        uint64_t count = records.size();
+        std::vector<TableFile::Section> sections = {{"count", &count, sizeof(count)},
+                                                    {"entries", records.data(), records.size() * sizeof(Record)}};
+        return TableFile::write(path, "solutions", FILE_VERSION, sections);
+    }
+
+private:
+    static const int SHARD_COUNT = 16;
+
+    struct Canonical {
+        CubeState state;
+        int symmetry;           // state is conjugate(inverted ? cube.inverse() : cube, symmetry)
+        bool inverted;
+    };
+
+    struct Entry {
+        CubeState state;
+        std::vector<int> moves; // solving state
+    };
+
+    struct Record {
+        uint64_t corners;
+        uint64_t edges;
+        uint8_t length;
+        uint8_t moves[MAX_MOVES];
+    };
+
+    static_assert(sizeof(Record) == 48, "solution cache record layout");
+
+    struct Hash {
+        size_t operator()(const CubeState &s) const {
+            uint64_t h = s.corners * 0x9e3779b97f4a7c15ULL ^ s.edges * 0xc2b2ae3d27d4eb4fULL;
+            return (size_t) (h ^ h >> 29);
+        }
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::list<Entry> recent;    // most recently used first
+        std::unordered_map<CubeState, std::list<Entry>::iterator, Hash> index;
+    };
+
+    static Canonical canonical(const CubeState &cube) {
+        Canonical best = {cube, 0, false};
+        CubeState inverse = cube.inverse();
+        for (int inverted = 0; inverted < 2; inverted++) {
+            for (int s = 0; s < SYMMETRY_COUNT; s++) {
+                CubeState c = conjugate(inverted ? inverse : cube, s);
+                if (c.corners < best.state.corners || (c.corners == best.state.corners && c.edges < best.state.edges))
+                    best = {c, s, inverted != 0};
+            }
+        }
+        return best;
+    }
+
+    Shard &shardOf(const CubeState &s) { return shards[(Hash()(s) >> 7) % SHARD_COUNT]; }
+
+    void store(const CubeState &state, const std::vector<int> &moves) {
+        Shard &shard = shardOf(state);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto it = shard.index.find(state);
+        if (it != shard.index.end()) {
+            shard.recent.splice(shard.recent.begin(), shard.recent, it->second);
+            if (moves.size() < it->second->moves.size()) {
+                it->second->moves = moves;
+                insertions++;
+            }
+            return;
+        }
+        if (shard.index.size() >= shardCapacity) {
+            shard.index.erase(shard.recent.back().state);
+            shard.recent.pop_back();
+            evictions++;
+        }
+        shard.recent.push_front({state, moves});
+        shard.index[state] = shard.recent.begin();
+        insertions++;
+    }
+
+    size_t shardCapacity;
+    Shard shards[SHARD_COUNT];
+    std::atomic<long> hits{0};
+    std::atomic<long> misses{0};
+    std::atomic<long> insertions{0};
+    std::atomic<long> evictions{0};
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <CUBE/CubeState.cpp>
+#include <SOLVER/Solution.cpp>
+
+/*
+ * Solves cubes on worker threads of its own, so that the thread asking, the render loop in particular, never waits
+ * for a solve. submit() queues a request and returns at once with a future of its Solution, which can be polled with
+ * wait_for(0); the optional `done` callback runs on the worker once the solution is final, and options.improved
+ * streams the shorter solutions on the way as usual.
+ *
+ * A request is stopped by cancelling the token of its options: still queued it is dropped, running it returns what
+ * it has found so far, in both cases with Solution::cancelled set. With coalescing only the newest waiting request is
+ * kept, a submit replaces the one still queued, which completes as cancelled: a newer scan of the cube makes the
+ * older ones moot. Requests replaced or dropped by cancelAll() also complete on a worker, once one is free, so
+ * `done` never runs on the thread calling submit() or cancelAll().
+ *
+ * Solver is TwoPhaseSolver or KorfSolver, one per worker on the shared tables.
+ */
+template <class Solver>
+class SolverService {
+public:
+    typedef std::function<void(const Solution &)> Callback;
+
+    /*
+     * `threads` workers, 0 for one per core.
+     */
+    template <class Tables>
+    explicit SolverService(const Tables &tables, int threads = 1, bool coalesce = true) : coalesce(coalesce) {
+        if (threads <= 0) threads = (int) std::max(1u, std::thread::hardware_concurrency());
+        running.resize(threads);
+        for (int w = 0; w < threads; w++) solvers.emplace_back(new Solver(tables));
+        for (int w = 0; w < threads; w++) workers.push_back(std::thread(&SolverService::run, this, w));
+    }
+
+    /*
+     * Cancels every request, queued or running, and waits for the running ones to return.
+     */
+    ~SolverService() {
+        cancelAll();
+        {
+            std::lock_guard<std::mutex> lock(queueLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &w : workers) w.join();
+    }
+
+    SolverService(const SolverService &) = delete;
+    SolverService &operator=(const SolverService &) = delete;
+
+    std::future<Solution> submit(const CubeState &cube, const SolveOptions &options, Callback done = Callback()) {
+        Request request;
+        request.cube = cube;
+        request.options = options;
+        request.done = std::move(done);
+        std::future<Solution> result = request.result.get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(queueLock);
+            if (coalesce) retire();
+            queue.push_back(std::move(request));
+        }
+        wake.notify_all();
+        return result;
+    }
+
+    void cancelAll() {
+        {
+            std::lock_guard<std::mutex> lock(queueLock);
+            retire();
+            for (const std::unique_ptr<CancellationToken> &token : running)
+                if (token) token->cancel();
+        }
+        wake.notify_all();
+    }
+
+    size_t queued() {
+        std::lock_guard<std::mutex> lock(queueLock);
+        return queue.size();
+    }
+
+    int threads() const { return (int) workers.size(); }
+
+private:
+    struct Request {
+        CubeState cube = CubeState::solved();
+        SolveOptions options;
+        Callback done;
+        std::promise<Solution> result;
+    };
+
+    static Solution cancelledSolution() {
+        Solution s;
+        s.cancelled = true;
+        return s;
+    }
+
+    static void complete(Request &r, const Solution &s) {
+        if (r.done) r.done(s);
+        r.result.set_value(s);
+    }
+
+    /*
+     * Move the queued requests to the ones a worker completes as cancelled. Called with queueLock held.
+     */
+    void retire() {
+        for (Request &r : queue) retired.push_back(std::move(r));
+        queue.clear();
+    }
+
+    void run(int w) {
+        for (;;) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(queueLock);
+                wake.wait(lock, [this] { return stopping || !queue.empty() || !retired.empty(); });
+                if (!retired.empty()) {
+                    request = std::move(retired.front());
+                    retired.pop_front();
+                    lock.unlock();
+                    complete(request, cancelledSolution());
+                    continue;
+                }
+                if (queue.empty()) return;
+                request = std::move(queue.front());
+                queue.pop_front();
+                running[w].reset(new CancellationToken(request.options.cancel));
+            }
+
+            Solution solution;
+            if (request.options.cancel.cancelled()) solution = cancelledSolution();
+            else solvers[w]->solve(request.cube, request.options, solution);
+            {
+                std::lock_guard<std::mutex> lock(queueLock);
+                running[w].reset();
+            }
+            complete(request, solution);
+        }
+    }
+
+    const bool coalesce;
+    std::vector<std::unique_ptr<Solver>> solvers;               // one per worker
+    std::vector<std::unique_ptr<CancellationToken>> running;    // token of the request each worker is solving
+    std::vector<std::thread> workers;
+    std::mutex queueLock;
+    std::condition_variable wake;
+    std::deque<Request> queue;
+    std::deque<Request> retired;    // replaced or dropped, to be completed as cancelled
+    bool stopping = false;
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <CUBE/Symmetry.cpp>
+#include <SOLVER/Coordinates.cpp>
+
+/*
+ * Corner coordinate reduced by the 16 symmetries that keep the U-D axis: cubes whose corners are conjugate are
+ * equally far from solved, so a corner pattern database needs one entry per class instead of one per cube.
+ *
+ * The corner permutations fall into CLASS_COUNT classes. A cube is reduced by conjugating it with the symmetry that
+ * takes its permutation to the smallest one of its class, the representative; the twist, conjugated with it, is
+ * kept whole. The index of the corners is then class * 3^7 + twist, 2768 * 2187 values against 8! * 3^7 for the raw
+ * coordinate. When symmetries fix the representative the twist is reduced by them too, to the smallest value, so
+ * that conjugate cubes always share one index.
+ */
+class CornerSymmetryCoordinate {
+public:
+    static const int CLASS_COUNT = 2768;
+    static const size_t INDEX_COUNT = (size_t) CLASS_COUNT * TWIST_COUNT;
+
+    void build() {
+        classOf.assign(CORNER_PERM_COUNT, UNASSIGNED);
+        representative.clear();
+        stabilizer.clear();
+        for (int cp = 0; cp < CORNER_PERM_COUNT; cp++) {
+            if (classOf[cp] != UNASSIGNED) continue;
+            uint32_t c = (uint32_t) representative.size();
+            CubeState rep = CubeState::solved();
+            setCornerPerm(rep, cp);
+            uint16_t fixedBy = 0;
+            for (int s = 0; s < UD_SYMMETRY_COUNT; s++) {
+                int other = cornerPermOf(conjugate(rep, s));
+                if (other == cp) fixedBy |= (uint16_t) (1 << s);
+                if (classOf[other] == UNASSIGNED) classOf[other] = c << 4 | symmetryTables.inverse[s];
+            }
+            representative.push_back((uint16_t) cp);
+            stabilizer.push_back(fixedBy);
+        }
+
+        twistConjugate.resize((size_t) TWIST_COUNT * UD_SYMMETRY_COUNT);
+        for (int twist = 0; twist < TWIST_COUNT; twist++) {
+            CubeState s = CubeState::solved();
+            setTwist(s, twist);
+            for (int sym = 0; sym < UD_SYMMETRY_COUNT; sym++)
+                twistConjugate[twist * UD_SYMMETRY_COUNT + sym] = (uint16_t) twistOf(conjugate(s, sym));
+        }
+    }
+
+    bool ready() const { return !twistConjugate.empty(); }
+
+    size_t index(const CubeState &s) const { return index(cornerPermOf(s), twistOf(s)); }
+
+    size_t index(int cornerPerm, int twist) const {
+        uint32_t cs = classOf[cornerPerm];
+        uint32_t c = cs >> 4;
+        int t = twistConjugate[twist * UD_SYMMETRY_COUNT + (cs & 15)];
+        if (stabilizer[c] != 1) {
+            int smallest = t;
+            for (int sym = 1; sym < UD_SYMMETRY_COUNT; sym++)
+                if (stabilizer[c] >> sym & 1)
+                    smallest = std::min(smallest, (int) twistConjugate[t * UD_SYMMETRY_COUNT + sym]);
+            t = smallest;
+        }
+        return (size_t) c * TWIST_COUNT + t;
+    }
+
+    /*
+     * The index reached from index i by a move, through the raw coordinate move tables.
+     */
+    size_t next(size_t i, int move, const CoordinateMoves &moves) const {
+        int cp = representative[i / TWIST_COUNT], twist = (int) (i % TWIST_COUNT);
+        return index(moves.cornerPerm[cp * MOVE_COUNT + move], moves.twist[twist * MOVE_COUNT + move]);
+    }
+
+private:
+    static constexpr uint32_t UNASSIGNED = 0xffffffff;
+
+    std::vector<uint32_t> classOf;          // per permutation: class << 4 | symmetry to the representative
+    std::vector<uint16_t> representative;   // per class
+    std::vector<uint16_t> stabilizer;       // per class: symmetries that fix the representative, bit per symmetry
+    std::vector<uint16_t> twistConjugate;   // per twist and symmetry
+};
+
+/*
+ * Phase 1 coordinate of the two-phase solver reduced by the same 16 symmetries: they keep the middle layer in place,
+ * so flip and slice together, slice * 2^11 + flip, are carried to flip and slice again and fall into CLASS_COUNT
+ * classes. With the twist conjugated alongside and reduced by the stabilizer as for the corners, the index is
+ * class * 3^7 + twist: 64430 * 2187 values, where a single pruning table over slice, flip and twist together would
+ * need 495 * 2^11 * 3^7, 16 times as many. It gives the exact phase 1 distance.
+ */
+class FlipSliceSymmetryCoordinate {
+public:
+    static const int CLASS_COUNT = 64430;
+    static const int RAW_COUNT = SLICE_COUNT * FLIP_COUNT;
+    static const size_t INDEX_COUNT = (size_t) CLASS_COUNT * TWIST_COUNT;
+
+    void build() {
+        ownedClassOf.assign(RAW_COUNT, UNASSIGNED);
+        ownedRepresentative.clear();
+        ownedStabilizer.clear();
+        std::vector<uint32_t> &classes = ownedClassOf;
+        for (int raw = 0; raw < RAW_COUNT; raw++) {
+            if (classes[raw] != UNASSIGNED) continue;
+            uint32_t c = (uint32_t) ownedRepresentative.size();
+            CubeState rep = CubeState::solved();
+            setSliceSorted(rep, raw / FLIP_COUNT * SLICE_PERM_COUNT);
+            setFlip(rep, raw % FLIP_COUNT);
+            uint16_t fixedBy = 0;
+            for (int s = 0; s < UD_SYMMETRY_COUNT; s++) {
+                CubeState conjugated = conjugate(rep, s);
+                int other = sliceSortedOf(conjugated) / SLICE_PERM_COUNT * FLIP_COUNT + flipOf(conjugated);
+                if (other == raw) fixedBy |= (uint16_t) (1 << s);
+                if (classes[other] == UNASSIGNED) classes[other] = c << 4 | symmetryTables.inverse[s];
+            }
+            ownedRepresentative.push_back((uint32_t) raw);
+            ownedStabilizer.push_back(fixedBy);
+        }
+
+        ownedTwistConjugate.resize((size_t) TWIST_COUNT * UD_SYMMETRY_COUNT);
+        for (int twist = 0; twist < TWIST_COUNT; twist++) {
+            CubeState s = CubeState::solved();
+            setTwist(s, twist);
+            for (int sym = 0; sym < UD_SYMMETRY_COUNT; sym++)
+                ownedTwistConjugate[twist * UD_SYMMETRY_COUNT + sym] = (uint16_t) twistOf(conjugate(s, sym));
+        }
+        classOf = ownedClassOf.data();
+        representative = ownedRepresentative.data();
+        stabilizer = ownedStabilizer.data();
+        twistConjugate = ownedTwistConjugate.data();
+    }
+
+    /*
+     * Use classes built elsewhere, from the sections of a table file; sectionBytes gives their sizes.
+     */
+    void attach(const uint32_t *classes, const uint32_t *representatives, const uint16_t *stabilizers,
+                const uint16_t *twistConjugates) {
+        classOf = classes;
+        representative = representatives;
+        stabilizer = stabilizers;
+        twistConjugate = twistConjugates;
+        ownedClassOf = std::vector<uint32_t>();
+        ownedRepresentative = std::vector<uint32_t>();
+        ownedStabilizer = std::vector<uint16_t>();
+        ownedTwistConjugate = std::vector<uint16_t>();
+    }
+
+    static const int SECTION_COUNT = 4;
+
+    /*
+     * The arrays in the order of attach(), with their sizes in bytes, to be written to a table file.
+     */
+    const void *section(int i) const {
+        const void *data[SECTION_COUNT] = {classOf, representative, stabilizer, twistConjugate};
+        return data[i];
+    }
+
+    static size_t sectionBytes(int i) {
+        static const size_t bytes[SECTION_COUNT] = {
+                RAW_COUNT * sizeof(uint32_t), CLASS_COUNT * sizeof(uint32_t), CLASS_COUNT * sizeof(uint16_t),
+                (size_t) TWIST_COUNT * UD_SYMMETRY_COUNT * sizeof(uint16_t)};
+        return bytes[i];
+    }
+
+    bool ready() const { return twistConjugate != NULL; }
+
+    size_t index(const CubeState &s) const {
+        return index(sliceSortedOf(s) / SLICE_PERM_COUNT, flipOf(s), twistOf(s));
+    }
+
+    size_t index(int slice, int flip, int twist) const {
+        uint32_t cs = classOf[slice * FLIP_COUNT + flip];
+        uint32_t c = cs >> 4;
+        int t = twistConjugate[twist * UD_SYMMETRY_COUNT + (cs & 15)];
+        if (stabilizer[c] != 1) {
+            int smallest = t;
+            for (int sym = 1; sym < UD_SYMMETRY_COUNT; sym++)
+                if (stabilizer[c] >> sym & 1)
+                    smallest = std::min(smallest, (int) twistConjugate[t * UD_SYMMETRY_COUNT + sym]);
+            t = smallest;
+        }
+        return (size_t) c * TWIST_COUNT + t;
+    }
+
+    /*
+     * The index reached from index i by a move, through the raw coordinate move tables.
+     */
+    size_t next(size_t i, int move, const CoordinateMoves &moves) const {
+        int raw = (int) representative[i / TWIST_COUNT], twist = (int) (i % TWIST_COUNT);
+        return index(moves.slice[raw / FLIP_COUNT * MOVE_COUNT + move],
+                     moves.flip[raw % FLIP_COUNT * MOVE_COUNT + move], moves.twist[twist * MOVE_COUNT + move]);
+    }
+
+private:
+    static constexpr uint32_t UNASSIGNED = 0xffffffff;
+
+    const uint32_t *classOf = NULL;         // per slice and flip: class << 4 | symmetry to the representative
+    const uint32_t *representative = NULL;  // per class
+    const uint16_t *stabilizer = NULL;      // per class: symmetries that fix the representative, bit per symmetry
+    const uint16_t *twistConjugate = NULL;  // per twist and symmetry
+    std::vector<uint32_t> ownedClassOf, ownedRepresentative;
+    std::vector<uint16_t> ownedStabilizer, ownedTwistConjugate;
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <UTIL/MappedFile.cpp>
+
+/*
+ * Container for precomputed solver tables: a TableFileHeader, one TableSectionEntry per table, then the tables
+ * themselves, each starting on a TABLE_ALIGN boundary so that it can be used in place from a mapping of the file.
+ *
+ * formatVersion is the layout of the container, contentVersion the version of the generator of the tables: a file
+ * with either one different is regenerated. Every section carries a checksum of its bytes and the header one of the
+ * section list.
+ */
+static const char TABLE_FILE_MAGIC[4] = {'R', 'C', 'T', 'B'};
+static const uint32_t TABLE_FORMAT_VERSION = 1;
+static const size_t TABLE_ALIGN = 16384;    // a page on every system we run on, 16 KB on Apple silicon
+
+struct TableFileHeader {
+    char magic[4];
+    uint32_t formatVersion;
+    uint32_t contentVersion;
+    uint32_t sectionCount;
+    char kind[16];              // which solver the tables belong to
+    uint64_t sectionsChecksum;  // of the section entries
+    uint8_t reserved[24];
+};
+
+struct TableSectionEntry {
+    char name[16];
+    uint64_t offset;            // from the start of the file, multiple of TABLE_ALIGN
+    uint64_t bytes;
+    uint64_t checksum;
+    uint8_t reserved[24];
+};
+
+static_assert(sizeof(TableFileHeader) == 64, "table file header layout");
+static_assert(sizeof(TableSectionEntry) == 64, "table section entry layout");
+
+inline size_t alignTable(size_t bytes) {
+    return (bytes + TABLE_ALIGN - 1) & ~(TABLE_ALIGN - 1);
+}
+
+/*
+ * 64-bit checksum, four independent multiply-xor lanes over 8-byte words so that it runs at memory speed.
+ */
+inline uint64_t tableChecksum(const void *data, size_t bytes) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t lane[4] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL, 0x9ce484222325cbf2ULL, 0x2325cbf29ce48422ULL};
+    const unsigned char *p = (const unsigned char *) data;
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            uint64_t w;
+            std::memcpy(&w, p + i + 8 * k, 8);
+            lane[k] = (lane[k] ^ w) * prime;
+            lane[k] ^= lane[k] >> 29;
+        }
+    }
+    uint64_t h = bytes;
+    for (int k = 0; k < 4; k++) h = (h ^ lane[k]) * prime;
+    for (; i < bytes; i++) h = (h ^ p[i]) * prime;
+    return h ^ (h >> 32);
+}
+
+struct TableLoadOptions {
+    bool prefault = true;       // map every page at load time rather than on first access
+    bool verify = true;         // check the section checksums, which reads every page
+    bool hugePages = false;     // copy large tables to huge pages instead of reading them in place from the file
+};
+
+/*
+ * A table file mapped read-only. Sections point straight into the mapping.
+ */
+class TableFile {
+public:
+    struct Section {
+        const char *name;
+        const void *data;
+        size_t bytes;
+    };
+
+    /*
+     * Write a table file. It is written under a temporary name and renamed, so a reader never sees half a file.
+     */
+    static bool write(const std::string &path, const char *kind, uint32_t contentVersion,
+                      const std::vector<Section> &sections) {
+        size_t offset = alignTable(sizeof(TableFileHeader) + sections.size() * sizeof(TableSectionEntry));
+        std::vector<TableSectionEntry> entries(sections.size());
+        for (size_t i = 0; i < sections.size(); i++) {
+            std::memset(&entries[i], 0, sizeof(TableSectionEntry));
+            std::strncpy(entries[i].name, sections[i].name, sizeof(entries[i].name) - 1);
+            entries[i].offset = offset;
+            entries[i].bytes = sections[i].bytes;
+            entries[i].checksum = tableChecksum(sections[i].data, sections[i].bytes);
+            offset = alignTable(offset + sections[i].bytes);
+        }
+
+        TableFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, TABLE_FILE_MAGIC, sizeof(header.magic));
+        header.formatVersion = TABLE_FORMAT_VERSION;
+        header.contentVersion = contentVersion;
+        header.sectionCount = (uint32_t) sections.size();
+        std::strncpy(header.kind, kind, sizeof(header.kind) - 1);
+        header.sectionsChecksum = tableChecksum(entries.data(), entries.size() * sizeof(TableSectionEntry));
+
+        std::string temporary = path + ".tmp";
+        MappedFile file;
+        if (!file.create(temporary, offset)) {
+            std::cerr << "ERROR! Unable to create table file " << temporary << "\n";
+            return false;
+        }
+        std::memset(file.data(), 0, offset);
+        std::memcpy(file.data(), &header, sizeof(header));
+        std::memcpy(file.data() + sizeof(header), entries.data(), entries.size() * sizeof(TableSectionEntry));
+        for (size_t i = 0; i < sections.size(); i++)
+            std::memcpy(file.data() + entries[i].offset, sections[i].data, sections[i].bytes);
+        file.setLength(offset);
+        file.close();
+
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::cerr << "ERROR! Unable to write table file " << path << "\n";
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Map a table file. Returns false, without complaining, when the file is missing, of another kind or version,
+     * or damaged: the caller then regenerates it. `problem` says which.
+     */
+    bool open(const std::string &path, const char *kind, uint32_t contentVersion, const TableLoadOptions &options,
+              const char **problem) {
+        close();
+        *problem = NULL;
+        if (!file.openReadOnly(path, options.prefault)) {
+            *problem = "missing";
+            return false;
+        }
+
+        const TableFileHeader *header = (const TableFileHeader *) file.data();
+        if (file.size() < sizeof(TableFileHeader) || std::memcmp(header->magic, TABLE_FILE_MAGIC, 4) != 0
+            || std::strncmp(header->kind, kind, sizeof(header->kind)) != 0) {
+            *problem = "not a table file of this solver";
+        } else if (header->formatVersion != TABLE_FORMAT_VERSION || header->contentVersion != contentVersion) {
+            *problem = "made by another version";
+        } else if (file.size() < sizeof(TableFileHeader) + header->sectionCount * sizeof(TableSectionEntry)) {
+            *problem = "truncated";
+        } else {
+            entries = (const TableSectionEntry *) (file.data() + sizeof(TableFileHeader));
+            entryCount = header->sectionCount;
+            if (tableChecksum(entries, entryCount * sizeof(TableSectionEntry)) != header->sectionsChecksum) {
+                *problem = "damaged section list";
+            }
+            for (size_t i = 0; i < entryCount && !*problem; i++) {
+                if (entries[i].offset % TABLE_ALIGN != 0 || entries[i].offset + entries[i].bytes > file.size()) {
+                    *problem = "truncated";
+                } else if (options.verify
+                           && tableChecksum(file.data() + entries[i].offset, entries[i].bytes) != entries[i].checksum) {
+                    *problem = "checksum mismatch";
+                }
+            }
+        }
+        if (*problem) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * The named section if it has the expected size, NULL otherwise.
+     */
+    const unsigned char *section(const char *name, size_t bytes) const {
+        for (size_t i = 0; i < entryCount; i++) {
+            if (std::strncmp(entries[i].name, name, sizeof(entries[i].name)) == 0 && entries[i].bytes == bytes)
+                return file.data() + entries[i].offset;
+        }
+        return NULL;
+    }
+
+    void close() {
+        file.close();
+        entries = NULL;
+        entryCount = 0;
+    }
+
+    bool isOpen() const { return file.isOpen(); }
+    size_t size() const { return file.size(); }
+
+private:
+    MappedFile file;
+    const TableSectionEntry *entries = NULL;
+    size_t entryCount = 0;
+};
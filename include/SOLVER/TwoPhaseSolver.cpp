@@ -0,0 +1,449 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <CUBE/CubeState.cpp>
+#include <CUBE/Symmetry.cpp>
+#include <SOLVER/Coordinates.cpp>
+#include <SOLVER/EndgameTable.cpp>
+#include <SOLVER/PruningTable.cpp>
+#include <SOLVER/Solution.cpp>
+#include <SOLVER/SymmetryCoordinates.cpp>
+#include <SOLVER/TableFile.cpp>
+#include <UTIL/WorkStealingPool.cpp>
+
+/*
+ * Move and pruning tables of the two-phase solver, built once and shared read-only by any number of solvers.
+ *
+ * Phase 1 prunes with the exact distance of slice, flip and twist together, indexed by their symmetry class; phase 2
+ * with the larger of two distances, for corner permutation and slice order, and U/D edge permutation and slice order
+ * together. About 75 MB, built in half a minute on one core or mapped from a table file in milliseconds.
+ */
+class TwoPhaseTables {
+public:
+    // bump when the coordinates, the move order or the pruning tables change: existing files are then regenerated
+    static const uint32_t TABLE_VERSION = 5;
+
+    CoordinateMoves moves;
+    FlipSliceSymmetryCoordinate flipSliceSymmetry;
+    PruningTable flipSliceTwist;    // flipSliceSymmetry.index(slice, flip, twist)
+    PruningTable cornerSlice;   // cornerPerm * SLICE_PERM_COUNT + slicePerm
+    PruningTable edgeSlice;     // udEdgePerm * SLICE_PERM_COUNT + slicePerm
+
+    bool ready() const { return !edgeSlice.empty(); }
+
+    /*
+     * Build all tables on `threads` threads (0 for all cores), the same tables for any number of threads. With
+     * progress every level of every pruning table is reported. Returns the totals over the pruning tables.
+     */
+    PruningTable::FillStats build(int threads = 0, bool progress = false) {
+        file.close();
+        moves.build(threads);
+
+        static const int allMoves[MOVE_COUNT] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17};
+        const CoordinateMoves &m = moves;
+        PruningTable::FillStats total, stats;
+
+        flipSliceSymmetry.build();
+        const FlipSliceSymmetryCoordinate &symmetry = flipSliceSymmetry;
+        flipSliceTwist.allocate(FlipSliceSymmetryCoordinate::INDEX_COUNT);
+        stats = flipSliceTwist.fillBreadthFirst(allMoves, MOVE_COUNT, [&m, &symmetry](size_t i, int move) {
+            return symmetry.next(i, move, m);
+        }, threads, progress ? "flipSliceTwist" : NULL);
+        accumulate(total, stats);
+        cornerSlice.allocate((size_t) CORNER_PERM_COUNT * SLICE_PERM_COUNT);
+        stats = cornerSlice.fillBreadthFirst(phase2Moves, PHASE2_MOVE_COUNT, [&m](size_t i, int move) {
+            size_t corner = i / SLICE_PERM_COUNT, slice = i % SLICE_PERM_COUNT;
+            return (size_t) m.cornerPerm[corner * MOVE_COUNT + move] * SLICE_PERM_COUNT
+                   + m.sliceSorted[slice * MOVE_COUNT + move];
+        }, threads, progress ? "cornerSlice" : NULL);
+        accumulate(total, stats);
+        edgeSlice.allocate((size_t) UD_EDGE_PERM_COUNT * SLICE_PERM_COUNT);
+        stats = edgeSlice.fillBreadthFirst(phase2Moves, PHASE2_MOVE_COUNT, [&m](size_t i, int move) {
+            size_t edge = i / SLICE_PERM_COUNT, slice = i % SLICE_PERM_COUNT;
+            return (size_t) m.udEdgePerm[edge * MOVE_COUNT + move] * SLICE_PERM_COUNT
+                   + m.sliceSorted[slice * MOVE_COUNT + move];
+        }, threads, progress ? "edgeSlice" : NULL);
+        accumulate(total, stats);
+        return total;
+    }
+
+    /*
+     * Use the tables of a file written by save(). Returns false, with the reason in `problem`, if it cannot be used.
+     */
+    bool load(const std::string &path, const TableLoadOptions &options, const char **problem) {
+        if (!file.open(path, "twophase", TABLE_VERSION, options, problem)) return false;
+
+        const unsigned char *moveData = file.section("moves", CoordinateMoves::entries() * sizeof(uint16_t));
+        const unsigned char *data[3];
+        PruningTable *tables[3] = {&flipSliceTwist, &cornerSlice, &edgeSlice};
+        static const char *names[3] = {"flipSliceTwist", "cornerSlice", "edgeSlice"};
+        static const size_t sizes[3] = {FlipSliceSymmetryCoordinate::INDEX_COUNT,
+                                        (size_t) CORNER_PERM_COUNT * SLICE_PERM_COUNT,
+                                        (size_t) UD_EDGE_PERM_COUNT * SLICE_PERM_COUNT};
+        for (int i = 0; i < 3; i++) data[i] = file.section(names[i], (sizes[i] + 1) / 2);
+        const unsigned char *classData[FlipSliceSymmetryCoordinate::SECTION_COUNT];
+        bool missing = !moveData || !data[0] || !data[1] || !data[2];
+        for (int i = 0; i < FlipSliceSymmetryCoordinate::SECTION_COUNT; i++) {
+            classData[i] = file.section(symmetryNames[i], FlipSliceSymmetryCoordinate::sectionBytes(i));
+            missing |= !classData[i];
+        }
+        if (missing) {
+            *problem = "a table is missing";
+            file.close();
+            return false;
+        }
+
+        moves.attach((const uint16_t *) moveData);
+        flipSliceSymmetry.attach((const uint32_t *) classData[0], (const uint32_t *) classData[1],
+                                 (const uint16_t *) classData[2], (const uint16_t *) classData[3]);
+        for (int i = 0; i < 3; i++) {
+            if (options.hugePages) tables[i]->copy(data[i], sizes[i]);
+            else tables[i]->attach(data[i], sizes[i]);
+        }
+        return true;
+    }
+
+    bool save(const std::string &path) const {
+        std::vector<TableFile::Section> sections = {
+                {"moves", moves.data(), CoordinateMoves::entries() * sizeof(uint16_t)},
+                {"flipSliceTwist", flipSliceTwist.data(), flipSliceTwist.bytes()},
+                {"cornerSlice", cornerSlice.data(), cornerSlice.bytes()},
+                {"edgeSlice", edgeSlice.data(), edgeSlice.bytes()}};
+        for (int i = 0; i < FlipSliceSymmetryCoordinate::SECTION_COUNT; i++)
+            sections.push_back({symmetryNames[i], flipSliceSymmetry.section(i),
+                                FlipSliceSymmetryCoordinate::sectionBytes(i)});
+        return TableFile::write(path, "twophase", TABLE_VERSION, sections);
+    }
+
+    /*
+     * Map the tables from `path`, or build them and write the file when it is missing, damaged or from another
+     * version. An empty path always builds.
+     */
+    void loadOrBuild(const std::string &path, const TableLoadOptions &options) {
+        double start = nowMs();
+        const char *problem = "no table file";
+        if (!path.empty() && load(path, options, &problem)) {
+            std::cout << "[solver] tables mapped from " << path << " in " << nowMs() - start << " ms" << std::endl;
+            return;
+        }
+
+        std::cout << "[solver] " << (path.empty() ? "no table file" : path + ": " + problem) << ", building tables"
+                  << std::endl;
+        PruningTable::FillStats stats = build();
+        std::cout << "[solver] tables built in " << nowMs() - start << " ms (" << stats.states / stats.seconds / 1e6
+                  << " M states/s)" << std::endl;
+        if (!path.empty() && save(path)) {
+            std::cout << "[solver] tables written to " << path << std::endl;
+        }
+    }
+
+    size_t bytes() const {
+        size_t total = CoordinateMoves::entries() * sizeof(uint16_t) + flipSliceTwist.bytes() + cornerSlice.bytes()
+                       + edgeSlice.bytes();
+        for (int i = 0; i < FlipSliceSymmetryCoordinate::SECTION_COUNT; i++)
+            total += FlipSliceSymmetryCoordinate::sectionBytes(i);
+        return total;
+    }
+
+private:
+    // sections of the flip and slice symmetry classes, in the order of FlipSliceSymmetryCoordinate::attach(); section
+    // names have at most 15 characters
+    static constexpr const char *symmetryNames[FlipSliceSymmetryCoordinate::SECTION_COUNT] = {
+            "flipSliceClass", "flipSliceRep", "flipSliceStab", "flipSliceTwists"};
+
+    static void accumulate(PruningTable::FillStats &total, const PruningTable::FillStats &stats) {
+        total.depth = std::max(total.depth, stats.depth);
+        total.states += stats.states;
+        total.seconds += stats.seconds;
+    }
+
+    static double nowMs() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    TableFile file;
+};
+
+/*
+ * Kociemba's two-phase algorithm. Phase 1 searches, with iterative deepening, for move sequences bringing the cube
+ * into the subgroup <U, D, R2, F2, L2, B2>; for each of them phase 2 searches for the shortest completion within the
+ * subgroup. Longer phase 1 sequences often allow a shorter total, so the search goes on until a solution of at most
+ * maxLength moves is found or time runs out, reporting every shorter solution on the way to options.improved.
+ *
+ * Which phase 1 sequences exist depends on the axis the cube is seen along, so with options.orientations above 1
+ * the cube is also searched turned onto the other two axes, and each of them inverted (a solution of the inverse,
+ * reversed and inverted, solves the cube), one search per orientation on a thread of its own. The searches share
+ * the length of the best solution so far: each prunes against it and all stop once it reaches maxLength.
+ *
+ * A solver runs one solve at a time.
+ */
+class TwoPhaseSolver {
+public:
+    explicit TwoPhaseSolver(const TwoPhaseTables &tables) : t(tables) {}
+
+    /*
+     * Returns false when the cube is not solvable or no solution was found in time.
+     */
+    bool solve(const CubeState &cube, const SolveOptions &options, Solution &solution) {
+        start = std::chrono::steady_clock::now();
+        solution = Solution();
+        if (cube.verify() != NULL) return false;
+        if (options.endgame && options.endgame->solve(cube, solution.moves)) {
+            solution.found = true;
+            solution.solveMs = elapsedMs();
+            if (options.improved) options.improved(solution);
+            return true;
+        }
+
+        sharedBest = MAX_SEARCH_LENGTH + 1;
+        int count = std::min(std::max(options.orientations, 1), ORIENTATION_COUNT);
+        if (count == 1) {
+            begin(cube, options, this, 0);
+            search();
+            collect(solution, {this});
+            return solution.found;
+        }
+
+        if (!pool || pool->threads() != count) pool.reset(new WorkStealingPool(count));
+        std::vector<TwoPhaseSolver *> all;
+        for (int o = 0; o < count; o++) {
+            if ((int) searches.size() <= o) searches.emplace_back(new TwoPhaseSolver(t));
+            TwoPhaseSolver *s = searches[o].get();
+            s->start = start;
+            s->begin(orient(cube, o), options, this, o);
+            pool->submit([s](int) { s->search(); });
+            all.push_back(s);
+        }
+        pool->wait();
+        collect(solution, all);
+        return solution.found;
+    }
+
+private:
+    static const int MAX_SEARCH_LENGTH = 30;
+    static const int ORIENTATION_COUNT = 6;
+
+    /*
+     * Orientation o is the cube, inverted when o is odd, seen through URF3^(o / 2).
+     */
+    static CubeState orient(const CubeState &c, int o) {
+        return conjugate(o % 2 ? c.inverse() : c, o / 2 * 16);
+    }
+
+    static std::vector<int> unorient(const int *moves, int length, int o) {
+        std::vector<int> r(moves, moves + length);
+        if (o == 0) return r;
+        r = conjugateMoves(r, symmetryTables.inverse[o / 2 * 16]);
+        return o % 2 ? inverseMoves(r) : r;
+    }
+
+    void begin(const CubeState &cube, const SolveOptions &options, TwoPhaseSolver *owner, int o) {
+        initial = cube;
+        maxLength = options.maxLength;
+        timeoutMs = options.timeoutMs;
+        improved = options.improved ? &options.improved : NULL;
+        cancel = options.cancel;
+        root = owner;
+        orientation = o;
+        bestLength = MAX_SEARCH_LENGTH + 1;
+        nodes = 0;
+        stopped = false;
+        timedOut = false;
+        cancelled = false;
+    }
+
+    void search() {
+        int twist = twistOf(initial), flip = flipOf(initial), slice = sliceSortedOf(initial) / SLICE_PERM_COUNT;
+        for (int depth1 = phase1Distance(slice, twist, flip); depth1 < bound() && !stopped; depth1++) {
+            phase1(slice, twist, flip, 0, depth1);
+        }
+    }
+
+    /*
+     * The shortest solution of the searches, in the orientation of the cube.
+     */
+    void collect(Solution &solution, const std::vector<TwoPhaseSolver *> &all) const {
+        const TwoPhaseSolver *shortest = all[0];
+        bool anyTimedOut = false, anyCancelled = false;
+        for (const TwoPhaseSolver *s : all) {
+            if (s->bestLength < shortest->bestLength) shortest = s;
+            anyTimedOut |= s->timedOut;
+            anyCancelled |= s->cancelled;
+            solution.nodes += s->nodes;
+        }
+        solution.found = shortest->bestLength <= MAX_SEARCH_LENGTH;
+        // a search may run out of time while another one reaches maxLength, the solve then did not time out
+        bool reached = shortest->bestLength <= shortest->maxLength;
+        solution.timedOut = anyTimedOut && !reached;
+        solution.cancelled = anyCancelled && !reached;
+        if (solution.found) solution.moves = unorient(shortest->best, shortest->bestLength, shortest->orientation);
+        solution.solveMs = elapsedMs();
+    }
+
+    /*
+     * Length of the best solution of all searches so far, solutions must be shorter.
+     */
+    int bound() const { return root->sharedBest.load(std::memory_order_relaxed); }
+
+    int phase1Distance(int slice, int twist, int flip) const {
+        return t.flipSliceTwist.get(t.flipSliceSymmetry.index(slice, flip, twist));
+    }
+
+    int phase2Distance(int corner, int edge, int slice) const {
+        return std::max(t.cornerSlice.get((size_t) corner * SLICE_PERM_COUNT + slice),
+                        t.edgeSlice.get((size_t) edge * SLICE_PERM_COUNT + slice));
+    }
+
+    /*
+     * Turning the same face twice in a row is never useful, and of two opposite faces only one order is needed.
+     */
+    static bool redundant(int move, int last) {
+        int face = moveFace(move), lastFace = moveFace(last);
+        return face == lastFace || face + 3 == lastFace;
+    }
+
+    double elapsedMs() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool checkTime() {
+        if ((++nodes & 4095) == 0) {
+            if (bound() <= maxLength) {
+                // another orientation found a short enough solution
+                stopped = true;
+            } else if (cancel.cancelled()) {
+                cancelled = true;
+                stopped = true;
+            } else if (elapsedMs() > timeoutMs) {
+                timedOut = true;
+                stopped = true;
+            }
+        }
+        return stopped;
+    }
+
+    void phase1(int slice, int twist, int flip, int depth, int togo) {
+        if (togo == 0) {
+            // a phase 1 sequence ending in a phase 2 move was already tried one move shorter
+            if (depth == 0 || !isPhase2Move(path[depth - 1])) startPhase2(depth);
+            return;
+        }
+        if (checkTime()) return;
+
+        // All children are indexed first, prefetching their entries, so that the reads of the large phase 1 table
+        // overlap instead of waiting for one another.
+        struct Child {
+            int move, slice, twist, flip;
+            size_t index;
+        };
+        Child children[MOVE_COUNT];
+        int n = 0;
+        for (int m = 0; m < MOVE_COUNT; m++) {
+            if (depth > 0 && redundant(m, path[depth - 1])) continue;
+            Child &c = children[n++];
+            c.move = m;
+            c.slice = t.moves.slice[slice * MOVE_COUNT + m];
+            c.twist = t.moves.twist[twist * MOVE_COUNT + m];
+            c.flip = t.moves.flip[flip * MOVE_COUNT + m];
+            c.index = t.flipSliceSymmetry.index(c.slice, c.flip, c.twist);
+            t.flipSliceTwist.prefetch(c.index);
+        }
+
+        for (int k = 0; k < n && !stopped; k++) {
+            const Child &c = children[k];
+            if (t.flipSliceTwist.get(c.index) >= togo) continue;
+            path[depth] = c.move;
+            phase1(c.slice, c.twist, c.flip, depth + 1, togo - 1);
+        }
+    }
+
+    void startPhase2(int depth1) {
+        // corners and slice order are cheap to follow and rule out most phase 1 sequences
+        int corner = cornerPermOf(initial), slice = sliceSortedOf(initial);
+        for (int i = 0; i < depth1; i++) {
+            corner = t.moves.cornerPerm[corner * MOVE_COUNT + path[i]];
+            slice = t.moves.sliceSorted[slice * MOVE_COUNT + path[i]];
+        }
+        int togoLimit = bound() - 1 - depth1;
+        if (t.cornerSlice.get((size_t) corner * SLICE_PERM_COUNT + slice) > togoLimit) return;
+
+        CubeState s = initial;
+        for (int i = 0; i < depth1; i++) s = s.move(path[i]);
+        int edge = udEdgePermOf(s);
+
+        for (int togo = phase2Distance(corner, edge, slice); togo <= togoLimit && !stopped; togo++) {
+            if (phase2(corner, edge, slice, depth1, togo)) {
+                bestLength = depth1 + togo;
+                std::copy(path, path + bestLength, best);
+                if (bestLength <= maxLength) stopped = true;
+                publish();
+                return;
+            }
+        }
+    }
+
+    /*
+     * Lower the shared bound to bestLength, and report the solution if no other search found one as short.
+     */
+    void publish() {
+        std::lock_guard<std::mutex> lock(root->publishLock);
+        if (bestLength >= root->sharedBest) return;
+        root->sharedBest = bestLength;
+        if (!improved) return;
+        Solution s;
+        s.moves = unorient(best, bestLength, orientation);
+        s.found = true;
+        s.nodes = nodes;
+        s.solveMs = elapsedMs();
+        (*improved)(s);
+    }
+
+    bool phase2(int corner, int edge, int slice, int depth, int togo) {
+        if (togo == 0) return corner == 0 && edge == 0 && slice == 0;
+        if (checkTime()) return false;
+
+        for (int k = 0; k < PHASE2_MOVE_COUNT; k++) {
+            int m = phase2Moves[k];
+            if (depth > 0 && redundant(m, path[depth - 1])) continue;
+            int c = t.moves.cornerPerm[corner * MOVE_COUNT + m];
+            int e = t.moves.udEdgePerm[edge * MOVE_COUNT + m];
+            int s = t.moves.sliceSorted[slice * MOVE_COUNT + m];
+            if (phase2Distance(c, e, s) >= togo) continue;
+            path[depth] = m;
+            if (phase2(c, e, s, depth + 1, togo - 1)) return true;
+        }
+        return false;
+    }
+
+    const TwoPhaseTables &t;
+    std::chrono::steady_clock::time_point start;
+    CubeState initial;
+    int maxLength = 20;
+    double timeoutMs = 1000.0;
+    const std::function<void(const Solution &)> *improved = NULL;
+    CancellationToken cancel;
+    int path[MAX_SEARCH_LENGTH + 1];
+    int best[MAX_SEARCH_LENGTH + 1];
+    int bestLength = MAX_SEARCH_LENGTH + 1;
+    long nodes = 0;
+    bool stopped = false;
+    bool timedOut = false;
+    bool cancelled = false;
+
+    TwoPhaseSolver *root = this;                // the solver whose solve() runs this search
+    int orientation = 0;
+    std::atomic<int> sharedBest{MAX_SEARCH_LENGTH + 1};    // of all searches, on the root
+    std::mutex publishLock;
+    std::unique_ptr<WorkStealingPool> pool;     // one worker per orientation
+    std::vector<std::unique_ptr<TwoPhaseSolver>> searches;
+};
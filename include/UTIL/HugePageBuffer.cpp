@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/*
+ * Anonymous memory for large tables read at random, backed by huge pages where the system has them so that a lookup
+ * needs fewer TLB entries: explicit huge pages (MAP_HUGETLB) when some are reserved, otherwise a region aligned to
+ * HUGE_PAGE_SIZE and marked for transparent huge pages (MADV_HUGEPAGE), otherwise ordinary pages. Buffers under one
+ * huge page always use ordinary pages. The memory starts zeroed.
+ */
+class HugePageBuffer {
+public:
+    static const size_t HUGE_PAGE_SIZE = (size_t) 2 << 20;
+
+    enum Backing { NONE, NORMAL_PAGES, TRANSPARENT_HUGE_PAGES, EXPLICIT_HUGE_PAGES };
+
+    HugePageBuffer() {}
+    ~HugePageBuffer() { release(); }
+
+    HugePageBuffer(const HugePageBuffer &) = delete;
+    HugePageBuffer &operator=(const HugePageBuffer &) = delete;
+
+    HugePageBuffer(HugePageBuffer &&o) noexcept { *this = std::move(o); }
+
+    HugePageBuffer &operator=(HugePageBuffer &&o) noexcept {
+        if (this != &o) {
+            release();
+            std::swap(base, o.base);
+            std::swap(mapped, o.mapped);
+            std::swap(offset, o.offset);
+            std::swap(length, o.length);
+            std::swap(backing, o.backing);
+        }
+        return *this;
+    }
+
+    /*
+     * Returns false, leaving the buffer empty, when no memory could be mapped.
+     */
+    bool allocate(size_t bytes) {
+        release();
+        if (bytes == 0) return true;
+        size_t rounded = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+        if (bytes >= HUGE_PAGE_SIZE) {
+            void *p = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) return take(p, rounded, 0, bytes, EXPLICIT_HUGE_PAGES);
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        if (bytes >= HUGE_PAGE_SIZE) {
+            // map a huge page more than needed and start at the first boundary in it
+            void *p = mmap(NULL, rounded + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                size_t skip = (HUGE_PAGE_SIZE - (uintptr_t) p % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+                madvise((unsigned char *) p + skip, rounded, MADV_HUGEPAGE);
+                return take(p, rounded + HUGE_PAGE_SIZE, skip, bytes, TRANSPARENT_HUGE_PAGES);
+            }
+        }
+#endif
+        void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return false;
+        return take(p, bytes, 0, bytes, NORMAL_PAGES);
+    }
+
+    void release() {
+        if (base) munmap(base, mapped);
+        base = NULL;
+        mapped = offset = length = 0;
+        backing = NONE;
+    }
+
+    unsigned char *data() const { return base ? base + offset : NULL; }
+    size_t size() const { return length; }
+    Backing pages() const { return backing; }
+
+    static const char *describe(Backing b) {
+        static const char *names[] = {"none", "normal pages", "transparent huge pages", "explicit huge pages"};
+        return names[b];
+    }
+
+private:
+    bool take(void *p, size_t mappedBytes, size_t start, size_t bytes, Backing b) {
+        base = (unsigned char *) p;
+        mapped = mappedBytes;
+        offset = start;
+        length = bytes;
+        backing = b;
+        return true;
+    }
+
+    unsigned char *base = NULL;     // start of the mapping
+    size_t mapped = 0;
+    size_t offset = 0;              // of the data in the mapping
+    size_t length = 0;
+    Backing backing = NONE;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+
+/*
+ * A file mapped in memory, either read-only for the whole file or writable with a capacity that can grow.
+ * Errors are reported by returning false, the object is then left closed.
+ */
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /*
+     * Map an existing file. Writes to the mapping stay private to this process.
+     */
+    bool openRead(const std::string &path) {
+        close();
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        length = capacity = (size_t) st.st_size;
+        void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close();
+            return false;
+        }
+        base = (unsigned char *) p;
+        writable = false;
+        return true;
+    }
+
+    /*
+     * Map an existing file read-only and shared, so any number of processes use the same pages. With prefault all
+     * pages are mapped now (MAP_POPULATE where the system has it, otherwise a read-ahead hint and a read of every
+     * page) instead of faulting on first access.
+     */
+    bool openReadOnly(const std::string &path, bool prefault) {
+        close();
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        length = capacity = (size_t) st.st_size;
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if (prefault) flags |= MAP_POPULATE;
+#endif
+        void *p = mmap(NULL, length, PROT_READ, flags, fd, 0);
+        if (p == MAP_FAILED) {
+            close();
+            return false;
+        }
+        base = (unsigned char *) p;
+        writable = false;
+#ifndef MAP_POPULATE
+        if (prefault) {
+            madvise(base, length, MADV_WILLNEED);
+            long page = sysconf(_SC_PAGESIZE);
+            volatile unsigned char sink = 0;
+            for (size_t i = 0; i < length; i += (size_t) page) sink ^= base[i];
+            (void) sink;
+        }
+#endif
+        return true;
+    }
+
+    /*
+     * Create (or truncate) a file and map the first initialCapacity bytes for writing.
+     */
+    bool create(const std::string &path, size_t initialCapacity) {
+        close();
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        writable = true;
+        length = 0;
+        if (!reserve(initialCapacity)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Make sure at least `bytes` bytes are mapped. The mapping may move, pointers into it become invalid.
+     */
+    bool reserve(size_t bytes) {
+        if (!writable) return false;
+        if (bytes <= capacity && base) return true;
+
+        size_t newCapacity = capacity ? capacity : bytes;
+        while (newCapacity < bytes) newCapacity *= 2;
+
+        if (base) munmap(base, capacity);
+        base = NULL;
+        if (ftruncate(fd, (off_t) newCapacity) != 0) return false;
+        void *p = mmap(NULL, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+        base = (unsigned char *) p;
+        capacity = newCapacity;
+        return true;
+    }
+
+    /*
+     * Number of bytes in use, the file is cut to that size when closed.
+     */
+    void setLength(size_t bytes) { length = bytes; }
+
+    void close() {
+        if (base) munmap(base, capacity);
+        if (fd >= 0 && writable) {
+            if (ftruncate(fd, (off_t) length) != 0) {
+                // the file keeps its preallocated tail, readers only trust the header
+            }
+        }
+        if (fd >= 0) ::close(fd);
+        base = NULL;
+        fd = -1;
+        length = capacity = 0;
+        writable = false;
+    }
+
+    bool isOpen() const { return base != NULL; }
+    unsigned char *data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    int fd = -1;
+    unsigned char *base = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    bool writable = false;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads, each with its own queue of tasks. A worker runs the newest task of its own queue and,
+ * when that is empty, steals the oldest task of another worker's, so that uneven tasks spread over all workers.
+ * Tasks submitted from outside are dealt round-robin; tasks submitted by a task go to the queue of its worker.
+ *
+ * A task receives the index of the worker running it, for per-worker state. wait() returns once every submitted
+ * task has finished, which makes it a barrier between rounds of work.
+ */
+class WorkStealingPool {
+public:
+    typedef std::function<void(int worker)> Task;
+
+    /*
+     * `threads` workers, 0 for one per core.
+     */
+    explicit WorkStealingPool(int threads = 0) {
+        if (threads <= 0) threads = (int) std::max(1u, std::thread::hardware_concurrency());
+        queues = std::vector<Queue>(threads);
+        for (int w = 0; w < threads; w++) workers.push_back(std::thread(&WorkStealingPool::run, this, w));
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &w : workers) w.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    int threads() const { return (int) queues.size(); }
+
+    void submit(Task task) {
+        unfinished++;
+        int w = currentWorker >= 0 && currentPool == this ? currentWorker : (int) (nextQueue++ % queues.size());
+        {
+            std::lock_guard<std::mutex> lock(queues[w].lock);
+            queues[w].tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    /*
+     * Block until all submitted tasks have run. Not to be called from a task.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(doneLock);
+        done.wait(lock, [this] { return unfinished == 0; });
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    static inline thread_local int currentWorker = -1;
+    static inline thread_local WorkStealingPool *currentPool = NULL;
+
+    bool take(int w, Task &task) {
+        {
+            std::lock_guard<std::mutex> lock(queues[w].lock);
+            if (!queues[w].tasks.empty()) {
+                task = std::move(queues[w].tasks.back());
+                queues[w].tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); k++) {
+            Queue &victim = queues[(w + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(int w) {
+        currentWorker = w;
+        currentPool = this;
+        for (;;) {
+            Task task;
+            if (take(w, task)) {
+                queued--;
+                task(w);
+                if (--unfinished == 0) {
+                    std::lock_guard<std::mutex> lock(doneLock);
+                    done.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepLock);
+            wake.wait(lock, [this] { return queued > 0 || stopping; });
+            if (stopping && queued <= 0) return;
+        }
+    }
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<long> queued{0};        // tasks in the queues, briefly negative while a submit is under way
+    std::atomic<long> unfinished{0};    // tasks submitted and not finished
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::mutex doneLock;
+    std::condition_variable done;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <CUBE/Facelets.cpp>
+
+/*
+ * Result of the global color assignment.
+ */
+struct ColorAssignment {
+    char facelets[FACELET_COUNT + 1];   // facelet string, NUL terminated
+    int cornerPermutation[CORNER_COUNT];
+    int cornerTwist[CORNER_COUNT];
+    int edgePermutation[EDGE_COUNT];
+    int edgeFlip[EDGE_COUNT];
+    double cost;                        // sum of the color distances of the assignment
+    bool solvable;                      // twist, flip and permutation parities allow solving
+    const char *problem;                // why it is not solvable, NULL if it is
+    double solveMs;
+};
+
+/*
+ * Assigns all 54 sampled stickers to the six colors at once instead of one by one.
+ *
+ * The stickers are not matched to colors but whole cubies to cubie slots: every corner (8 x 8 x 3 twists) and edge
+ * (12 x 12 x 2 flips) assignment is scored by the Lab distance of its stickers to the face colors, and the best
+ * permutation is found exactly with the Hungarian algorithm. A result is therefore always a set of real cubies,
+ * each color on exactly nine stickers and no impossible corner or edge. The face colors start at the centers and
+ * are re-estimated from the assigned stickers for a few rounds, which follows lighting drift across the cube.
+ * Both assignments are 12x12 at most, the whole thing runs in microseconds.
+ */
+class ColorAssigner {
+public:
+    /*
+     * lab: Lab color of every facelet, in facelet order.
+     */
+    void assign(const float lab[FACELET_COUNT][3], ColorAssignment &result) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        float reference[FACE_COUNT][3];
+        for (int f = 0; f < FACE_COUNT; f++) {
+            std::memcpy(reference[f], lab[facelet(f, 5)], sizeof(reference[f]));
+        }
+
+        int faceOf[FACELET_COUNT];
+        for (int round = 0; round < ROUNDS; round++) {
+            result.cost = assignCubies(lab, reference, result);
+
+            faceletFaces(result, faceOf);
+            if (!updateReferences(lab, faceOf, reference)) break;
+        }
+
+        for (int i = 0; i < FACELET_COUNT; i++) result.facelets[i] = faceNames[faceOf[i]];
+        result.facelets[FACELET_COUNT] = '\0';
+        checkSolvable(result);
+        result.solveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    static const int ROUNDS = 4;
+    static const int MAX_N = EDGE_COUNT;
+
+    static float distance(const float a[3], const float b[3]) {
+        // lightness counts half, it varies most with the lighting
+        float dl = 0.5f * (a[0] - b[0]), da = a[1] - b[1], db = a[2] - b[2];
+        return dl * dl + da * da + db * db;
+    }
+
+    double assignCubies(const float lab[FACELET_COUNT][3], const float reference[FACE_COUNT][3],
+                        ColorAssignment &result) {
+        double cornerCost[MAX_N][MAX_N], edgeCost[MAX_N][MAX_N];
+        int cornerBestTwist[MAX_N][MAX_N], edgeBestFlip[MAX_N][MAX_N];
+
+        for (int slot = 0; slot < CORNER_COUNT; slot++) {
+            for (int cubie = 0; cubie < CORNER_COUNT; cubie++) {
+                cornerCost[slot][cubie] = 1e30;
+                for (int twist = 0; twist < 3; twist++) {
+                    double c = 0.0;
+                    for (int n = 0; n < 3; n++)
+                        c += distance(lab[cornerFacelet[slot][(n + twist) % 3]], reference[cornerColor[cubie][n]]);
+                    if (c < cornerCost[slot][cubie]) {
+                        cornerCost[slot][cubie] = c;
+                        cornerBestTwist[slot][cubie] = twist;
+                    }
+                }
+            }
+        }
+        for (int slot = 0; slot < EDGE_COUNT; slot++) {
+            for (int cubie = 0; cubie < EDGE_COUNT; cubie++) {
+                edgeCost[slot][cubie] = 1e30;
+                for (int flip = 0; flip < 2; flip++) {
+                    double c = 0.0;
+                    for (int n = 0; n < 2; n++)
+                        c += distance(lab[edgeFacelet[slot][(n + flip) % 2]], reference[edgeColor[cubie][n]]);
+                    if (c < edgeCost[slot][cubie]) {
+                        edgeCost[slot][cubie] = c;
+                        edgeBestFlip[slot][cubie] = flip;
+                    }
+                }
+            }
+        }
+
+        double cost = hungarian(cornerCost, CORNER_COUNT, result.cornerPermutation)
+                      + hungarian(edgeCost, EDGE_COUNT, result.edgePermutation);
+        for (int slot = 0; slot < CORNER_COUNT; slot++)
+            result.cornerTwist[slot] = cornerBestTwist[slot][result.cornerPermutation[slot]];
+        for (int slot = 0; slot < EDGE_COUNT; slot++)
+            result.edgeFlip[slot] = edgeBestFlip[slot][result.edgePermutation[slot]];
+        return cost;
+    }
+
+    /*
+     * Minimum cost perfect matching of rows to columns (O(n^3), potentials and shortest augmenting paths).
+     * assignment[row] receives the column. Returns the total cost.
+     */
+    static double hungarian(const double cost[MAX_N][MAX_N], int n, int assignment[]) {
+        double u[MAX_N + 1] = {}, v[MAX_N + 1] = {}, minv[MAX_N + 1];
+        int p[MAX_N + 1] = {}, way[MAX_N + 1] = {};
+        bool used[MAX_N + 1];
+
+        for (int i = 1; i <= n; i++) {
+            p[0] = i;
+            int j0 = 0;
+            for (int j = 0; j <= n; j++) {
+                minv[j] = 1e300;
+                used[j] = false;
+            }
+            do {
+                used[j0] = true;
+                int i0 = p[j0], j1 = 0;
+                double delta = 1e300;
+                for (int j = 1; j <= n; j++) {
+                    if (used[j]) continue;
+                    double cur = cost[i0 - 1][j - 1] - u[i0] - v[j];
+                    if (cur < minv[j]) {
+                        minv[j] = cur;
+                        way[j] = j0;
+                    }
+                    if (minv[j] < delta) {
+                        delta = minv[j];
+                        j1 = j;
+                    }
+                }
+                for (int j = 0; j <= n; j++) {
+                    if (used[j]) {
+                        u[p[j]] += delta;
+                        v[j] -= delta;
+                    } else {
+                        minv[j] -= delta;
+                    }
+                }
+                j0 = j1;
+            } while (p[j0] != 0);
+            do {
+                int j1 = way[j0];
+                p[j0] = p[j1];
+                j0 = j1;
+            } while (j0);
+        }
+
+        double total = 0.0;
+        for (int j = 1; j <= n; j++) {
+            assignment[p[j] - 1] = j - 1;
+            total += cost[p[j] - 1][j - 1];
+        }
+        return total;
+    }
+
+    static void faceletFaces(const ColorAssignment &result, int faceOf[FACELET_COUNT]) {
+        for (int f = 0; f < FACE_COUNT; f++) faceOf[facelet(f, 5)] = f;
+        for (int slot = 0; slot < CORNER_COUNT; slot++)
+            for (int n = 0; n < 3; n++)
+                faceOf[cornerFacelet[slot][(n + result.cornerTwist[slot]) % 3]] =
+                        cornerColor[result.cornerPermutation[slot]][n];
+        for (int slot = 0; slot < EDGE_COUNT; slot++)
+            for (int n = 0; n < 2; n++)
+                faceOf[edgeFacelet[slot][(n + result.edgeFlip[slot]) % 2]] = edgeColor[result.edgePermutation[slot]][n];
+    }
+
+    /*
+     * Face colors as the mean of their nine stickers. Returns false once they no longer move.
+     */
+    static bool updateReferences(const float lab[FACELET_COUNT][3], const int faceOf[FACELET_COUNT],
+                                 float reference[FACE_COUNT][3]) {
+        float sum[FACE_COUNT][3] = {};
+        for (int i = 0; i < FACELET_COUNT; i++)
+            for (int k = 0; k < 3; k++) sum[faceOf[i]][k] += lab[i][k];
+
+        bool moved = false;
+        for (int f = 0; f < FACE_COUNT; f++) {
+            float mean[3] = {sum[f][0] / 9.0f, sum[f][1] / 9.0f, sum[f][2] / 9.0f};
+            moved = moved || distance(mean, reference[f]) > 0.01f;
+            std::memcpy(reference[f], mean, sizeof(mean));
+        }
+        return moved;
+    }
+
+    static int parity(const int *permutation, int n) {
+        int p = 0;
+        for (int i = 0; i < n; i++)
+            for (int j = i + 1; j < n; j++)
+                if (permutation[i] > permutation[j]) p ^= 1;
+        return p;
+    }
+
+    static void checkSolvable(ColorAssignment &result) {
+        int twist = 0, flip = 0;
+        for (int i = 0; i < CORNER_COUNT; i++) twist += result.cornerTwist[i];
+        for (int i = 0; i < EDGE_COUNT; i++) flip += result.edgeFlip[i];
+
+        result.problem = NULL;
+        if (twist % 3 != 0) {
+            result.problem = "a corner is twisted";
+        } else if (flip % 2 != 0) {
+            result.problem = "an edge is flipped";
+        } else if (parity(result.cornerPermutation, CORNER_COUNT) != parity(result.edgePermutation, EDGE_COUNT)) {
+            result.problem = "two pieces are swapped";
+        }
+        result.solvable = result.problem == NULL;
+    }
+};
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <VISION/GridDetector.cpp>
+
+/*
+ * Unit quaternion, only what the pose filter needs.
+ */
+struct Quat {
+    double w = 1.0, x = 0.0, y = 0.0, z = 0.0;
+
+    Quat() {}
+    Quat(double qw, double qx, double qy, double qz) : w(qw), x(qx), y(qy), z(qz) {}
+
+    Quat operator*(const Quat &o) const {
+        return Quat(w * o.w - x * o.x - y * o.y - z * o.z,
+                    w * o.x + x * o.w + y * o.z - z * o.y,
+                    w * o.y - x * o.z + y * o.w + z * o.x,
+                    w * o.z + x * o.y - y * o.x + z * o.w);
+    }
+
+    Quat conjugate() const { return Quat(w, -x, -y, -z); }
+
+    /*
+     * Rotation of angle |v| around v.
+     */
+    static Quat fromRotationVector(double vx, double vy, double vz) {
+        double angle = std::sqrt(vx * vx + vy * vy + vz * vz);
+        if (angle < 1e-12) return Quat(1.0, 0.5 * vx, 0.5 * vy, 0.5 * vz);
+        double s = std::sin(0.5 * angle) / angle;
+        return Quat(std::cos(0.5 * angle), vx * s, vy * s, vz * s);
+    }
+
+    void toRotationVector(double &vx, double &vy, double &vz) const {
+        // shortest rotation
+        double sign = w < 0.0 ? -1.0 : 1.0;
+        double n = std::sqrt(x * x + y * y + z * z);
+        if (n < 1e-12) {
+            vx = 2.0 * sign * x;
+            vy = 2.0 * sign * y;
+            vz = 2.0 * sign * z;
+            return;
+        }
+        double angle = 2.0 * std::atan2(n, sign * w);
+        vx = sign * x / n * angle;
+        vy = sign * y / n * angle;
+        vz = sign * z / n * angle;
+    }
+
+    Quat normalized() const {
+        double n = std::sqrt(w * w + x * x + y * y + z * z);
+        return Quat(w / n, x / n, y / n, z / n);
+    }
+};
+
+/*
+ * 6-DoF pose of the cube in the camera frame: x = R * X + t, X in cube coordinates.
+ *
+ * Cube coordinates: origin at the center of the cube, the tracked face is the z = -size/2 face with its stickers
+ * going along +x (columns) and +y (rows), so that the other visible faces are -x/+x, -y/+y.
+ */
+struct CubePose {
+    cv::Mat rvec = cv::Mat::zeros(3, 1, CV_64F);
+    cv::Mat tvec = cv::Mat::zeros(3, 1, CV_64F);
+    bool valid = false;
+};
+
+/*
+ * Estimates the cube pose from the detected face with solvePnP and smooths it with a constant velocity filter
+ * (position and rotation, alpha-beta gains).
+ *
+ * Once tracking, the previous pose seeds both the corner ordering of the new detection (the face grid is
+ * 4-fold symmetric) and an iterative solvePnP over 13 points, which keeps the tracked path well under 1 ms.
+ */
+class CubeTracker {
+public:
+    explicit CubeTracker(double cubeSize = 57.0) : size(cubeSize) {
+        double h = 0.5 * size, step = size / 3.0;
+        faceModel.push_back(cv::Point3f((float) -h, (float) -h, (float) -h));
+        faceModel.push_back(cv::Point3f((float) h, (float) -h, (float) -h));
+        faceModel.push_back(cv::Point3f((float) h, (float) h, (float) -h));
+        faceModel.push_back(cv::Point3f((float) -h, (float) h, (float) -h));
+        for (int row = 0; row < 3; row++)
+            for (int col = 0; col < 3; col++)
+                faceModel.push_back(cv::Point3f((float) (-h + (col + 0.5) * step), (float) (-h + (row + 0.5) * step),
+                                                (float) -h));
+    }
+
+    /*
+     * Feed a detection made at timeMs. K and dist describe the camera of the image the grid was found in.
+     * Returns false if the detection does not give a plausible pose.
+     */
+    bool update(const FaceGrid &grid, const cv::Mat &K, const cv::Mat &dist, double timeMs) {
+        Clock::time_point start = Clock::now();
+        bool tracked = state.valid;
+
+        int shift = 0;
+        if (tracked) {
+            predict(timeMs);
+            shift = bestCornerShift(grid, K, dist);
+            measured.rvec = predicted.rvec.clone();
+            measured.tvec = predicted.tvec.clone();
+        }
+
+        imagePoints.clear();
+        // rotating the corner order rotates the sticker grid with it
+        for (int k = 0; k < 4; k++) imagePoints.push_back(grid.corners[(k + shift) % 4]);
+        for (int row = 0; row < 3; row++)
+            for (int col = 0; col < 3; col++)
+                imagePoints.push_back(grid.centers[rotatedSticker(row, col, shift)]);
+
+        bool solved = tracked
+                ? cv::solvePnP(faceModel, imagePoints, K, dist, measured.rvec, measured.tvec, true,
+                               cv::SOLVEPNP_ITERATIVE)
+                : cv::solvePnP(faceModel, imagePoints, K, dist, measured.rvec, measured.tvec, false,
+                               cv::SOLVEPNP_IPPE);
+
+        solved = solved && reprojectionError(K, dist) < MAX_REPROJECTION_ERROR * faceSidePixels(grid);
+        solveMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        solveTracked = tracked;
+
+        consistent = false;
+        if (!solved) {
+            if (++misses >= MAX_MISSES) lose();
+            return false;
+        }
+        misses = 0;
+        correct(timeMs);
+        return true;
+    }
+
+    /*
+     * Extrapolate the filtered pose to timeMs.
+     */
+    void predict(double timeMs) {
+        double dt = timeMs - lastUpdateMs;
+        cv::Mat p = position + velocity * dt;
+        Quat q = Quat::fromRotationVector(angularVelocity[0] * dt, angularVelocity[1] * dt,
+                                          angularVelocity[2] * dt) * orientation;
+        setPose(predicted, q.normalized(), p);
+    }
+
+    /*
+     * Detection failed this frame.
+     */
+    void missed() {
+        if (state.valid && ++misses >= MAX_MISSES) lose();
+    }
+
+    void lose() {
+        state.valid = false;
+        misses = 0;
+    }
+
+    bool tracking() const { return state.valid; }
+
+    /*
+     * True if the last detection was accepted and agreed with the predicted pose.
+     */
+    bool poseConsistent() const { return consistent; }
+    const CubePose &pose() const { return state; }
+    double cubeSize() const { return size; }
+
+    /*
+     * Time the last update() spent estimating the pose, and whether it refined a tracked pose rather than starting
+     * from scratch.
+     */
+    double poseSolveMs() const { return solveMs; }
+    bool poseSolveTracked() const { return solveTracked; }
+
+    /*
+     * Project points given in cube coordinates with the filtered pose.
+     */
+    void project(const std::vector<cv::Point3f> &points, const cv::Mat &K, const cv::Mat &dist,
+                 std::vector<cv::Point2f> &projected) const {
+        cv::projectPoints(points, state.rvec, state.tvec, K, dist, projected);
+    }
+
+    /*
+     * Image region covered by the cube, grown by `margin` (fraction of its size).
+     */
+    cv::Rect bounds(const cv::Mat &K, const cv::Mat &dist, double margin) const {
+        std::vector<cv::Point3f> corners;
+        double h = 0.5 * size;
+        for (int i = 0; i < 8; i++)
+            corners.push_back(cv::Point3f((float) (i & 1 ? h : -h), (float) (i & 2 ? h : -h), (float) (i & 4 ? h : -h)));
+        std::vector<cv::Point2f> projected;
+        project(corners, K, dist, projected);
+        cv::Rect box = cv::boundingRect(projected);
+        int mx = (int) (box.width * margin), my = (int) (box.height * margin);
+        return cv::Rect(box.x - mx, box.y - my, box.width + 2 * mx, box.height + 2 * my);
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const int MAX_MISSES = 10;
+    // largest mean reprojection error accepted, as a fraction of the face side
+    static constexpr double MAX_REPROJECTION_ERROR = 0.05;
+    // largest difference between the measured and the predicted pose for a consistent detection
+    static constexpr double MAX_ROTATION_INNOVATION = 0.26;     // radians
+    static constexpr double MAX_TRANSLATION_INNOVATION = 0.25;  // cube sizes
+    static constexpr double ALPHA = 0.6;
+    static constexpr double BETA = 0.2;
+
+    /*
+     * Index of the sticker that lands on (row, col) once the corner order is rotated by `shift` quarter turns.
+     */
+    static int rotatedSticker(int row, int col, int shift) {
+        for (int k = 0; k < shift; k++) {
+            int c = col;
+            col = 2 - row;
+            row = c;
+        }
+        return row * 3 + col;
+    }
+
+    /*
+     * The rotation of the detected corners that best matches the predicted pose.
+     */
+    int bestCornerShift(const FaceGrid &grid, const cv::Mat &K, const cv::Mat &dist) {
+        std::vector<cv::Point3f> corners(faceModel.begin(), faceModel.begin() + 4);
+        std::vector<cv::Point2f> expected;
+        cv::projectPoints(corners, predicted.rvec, predicted.tvec, K, dist, expected);
+        int best = 0;
+        double bestError = 1e30;
+        for (int shift = 0; shift < 4; shift++) {
+            double error = 0.0;
+            for (int k = 0; k < 4; k++) {
+                cv::Point2f d = grid.corners[(k + shift) % 4] - expected[k];
+                error += d.dot(d);
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = shift;
+            }
+        }
+        return best;
+    }
+
+    double reprojectionError(const cv::Mat &K, const cv::Mat &dist) {
+        cv::projectPoints(faceModel, measured.rvec, measured.tvec, K, dist, reprojected);
+        double sum = 0.0;
+        for (size_t i = 0; i < reprojected.size(); i++) {
+            cv::Point2f d = reprojected[i] - imagePoints[i];
+            sum += std::sqrt(d.dot(d));
+        }
+        return sum / reprojected.size();
+    }
+
+    static double faceSidePixels(const FaceGrid &grid) {
+        cv::Point2f d = grid.corners[1] - grid.corners[0];
+        return std::sqrt(d.dot(d));
+    }
+
+    /*
+     * Blend the measured pose into the filter state.
+     */
+    void correct(double timeMs) {
+        Quat q = Quat::fromRotationVector(measured.rvec.at<double>(0), measured.rvec.at<double>(1),
+                                          measured.rvec.at<double>(2));
+        if (!state.valid) {
+            // nothing to compare a first detection with
+            consistent = false;
+            orientation = q;
+            position = measured.tvec.clone();
+            velocity = cv::Mat::zeros(3, 1, CV_64F);
+            angularVelocity[0] = angularVelocity[1] = angularVelocity[2] = 0.0;
+        } else {
+            double dt = std::max(timeMs - lastUpdateMs, 1.0);
+            Quat predictedQ = Quat::fromRotationVector(predicted.rvec.at<double>(0), predicted.rvec.at<double>(1),
+                                                       predicted.rvec.at<double>(2));
+            double e[3];
+            (q * predictedQ.conjugate()).toRotationVector(e[0], e[1], e[2]);
+            orientation = (Quat::fromRotationVector(ALPHA * e[0], ALPHA * e[1], ALPHA * e[2]) * predictedQ).normalized();
+            for (int i = 0; i < 3; i++) angularVelocity[i] += BETA * e[i] / dt;
+
+            cv::Mat residual = measured.tvec - predicted.tvec;
+            consistent = std::sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]) < MAX_ROTATION_INNOVATION
+                         && cv::norm(residual) < MAX_TRANSLATION_INNOVATION * size;
+            position = predicted.tvec + ALPHA * residual;
+            velocity = velocity + (BETA / dt) * residual;
+        }
+        lastUpdateMs = timeMs;
+        setPose(state, orientation, position);
+    }
+
+    static void setPose(CubePose &pose, const Quat &q, const cv::Mat &t) {
+        double v[3];
+        q.toRotationVector(v[0], v[1], v[2]);
+        pose.rvec = (cv::Mat_<double>(3, 1) << v[0], v[1], v[2]);
+        pose.tvec = t.clone();
+        pose.valid = true;
+    }
+
+    double size;
+    std::vector<cv::Point3f> faceModel;     // 4 corners then 9 sticker centers of the tracked face
+    std::vector<cv::Point2f> imagePoints;
+    std::vector<cv::Point2f> reprojected;
+
+    CubePose state;         // filtered
+    CubePose measured;      // last solvePnP result
+    CubePose predicted;
+
+    Quat orientation;
+    cv::Mat position = cv::Mat::zeros(3, 1, CV_64F);
+    cv::Mat velocity = cv::Mat::zeros(3, 1, CV_64F);    // per ms
+    double angularVelocity[3] = {0.0, 0.0, 0.0};        // rad per ms
+    double lastUpdateMs = 0.0;
+    int misses = 0;
+    bool consistent = false;
+    double solveMs = 0.0;
+    bool solveTracked = false;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <VISION/StickerSampler.cpp>
+
+/*
+ * Color scheme of a standard cube, used to name the faces by their center: U white, R red, F green, D yellow,
+ * L orange, B blue. Indexed by StickerColor, gives the face in U R F D L B order.
+ */
+static const int faceOfCenterColor[COLOR_COUNT] = {POSE_U, POSE_D, POSE_R, POSE_L, POSE_B, POSE_F};
+
+/*
+ * Direction of each neighbour of a face in the net orientation of FaceSample: 0 up, 1 right, 2 down, 3 left,
+ * -1 for the face itself and the opposite face. neighbourDirection[face][neighbour].
+ */
+static const int neighbourDirection[POSE_FACE_COUNT][POSE_FACE_COUNT] = {
+        //U   R   F   D   L   B
+        {-1,  1,  2, -1,  3,  0},   // U
+        { 0, -1,  3,  2, -1,  1},   // R
+        { 0,  1, -1,  2,  3, -1},   // F
+        {-1,  1,  0, -1,  3,  2},   // D
+        { 0, -1,  1,  2, -1,  3},   // L
+        { 0,  3, -1,  2,  1, -1}};  // B
+
+/*
+ * Votes over recent frames for the color of every sticker, one face at a time.
+ *
+ * Faces are identified by their center color and turned to the net orientation using a neighbouring face seen in
+ * the same frame, so votes from different views of the cube land on the same stickers. Each face keeps a ring of
+ * the last HISTORY frames; per-sticker color histograms and Lab sums are updated incrementally as frames enter and
+ * leave the ring, so an update costs a few dozen additions and never allocates.
+ */
+class FaceAccumulator {
+public:
+    static const int HISTORY = 16;
+    static const int VOTE_THRESHOLD = 10;       // votes the winning color needs
+    static constexpr float MIN_AGREEMENT = 0.8f; // share of the votes the winning color needs
+
+    FaceAccumulator() { reset(); }
+
+    void reset() {
+        std::memset(faces, 0, sizeof(faces));
+    }
+
+    /*
+     * Add the faces read in one frame. The frame is dropped when the tracker did not find the pose consistent with
+     * its prediction, or when the centers do not describe faces that can be neighbours. Returns the number of faces
+     * that became committed (or changed their committed colors) with this frame.
+     */
+    int addFrame(const std::vector<FaceSample> &samples, bool poseConsistent) {
+        if (!poseConsistent || samples.size() < 2) return 0;
+
+        int canonical[POSE_FACE_COUNT];
+        int rotation[POSE_FACE_COUNT];
+        for (size_t i = 0; i < samples.size(); i++) {
+            canonical[i] = faceOfCenterColor[samples[i].colors[4]];
+            for (size_t j = 0; j < i; j++) {
+                if (canonical[i] == canonical[j]) return 0;
+            }
+        }
+
+        // a visible face always has another visible face next to it, which fixes its rotation; all of them must agree
+        for (size_t i = 0; i < samples.size(); i++) {
+            rotation[i] = -1;
+            for (size_t j = 0; j < samples.size(); j++) {
+                if (i == j) continue;
+                int seen = neighbourDirection[samples[i].face][samples[j].face];
+                int expected = neighbourDirection[canonical[i]][canonical[j]];
+                if (seen < 0) continue;
+                if (expected < 0) return 0;
+                int r = (expected - seen + 4) % 4;
+                if (rotation[i] >= 0 && rotation[i] != r) return 0;
+                rotation[i] = r;
+            }
+            if (rotation[i] < 0) return 0;
+        }
+
+        int changed = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            changed += vote(canonical[i], samples[i], rotation[i]);
+        }
+        return changed;
+    }
+
+    bool committed(int face) const { return faces[face].committed; }
+
+    bool allCommitted() const {
+        for (int f = 0; f < POSE_FACE_COUNT; f++)
+            if (!faces[f].committed) return false;
+        return true;
+    }
+
+    /*
+     * Committed color of a sticker, in net orientation.
+     */
+    int color(int face, int sticker) const { return faces[face].committedColors[sticker]; }
+
+    /*
+     * Mean Lab of the frames that voted for the committed color of a sticker.
+     */
+    cv::Vec3f meanLab(int face, int sticker) const {
+        const FaceVotes &f = faces[face];
+        int c = f.committedColors[sticker];
+        int n = f.counts[sticker][c];
+        if (n == 0) return cv::Vec3f(0.0f, 0.0f, 0.0f);
+        return cv::Vec3f(f.labSum[sticker][c][0] / n, f.labSum[sticker][c][1] / n, f.labSum[sticker][c][2] / n);
+    }
+
+private:
+    struct FaceVotes {
+        uint8_t ringColors[HISTORY][9];
+        float ringLab[HISTORY][9][3];
+        int head;       // next slot of the ring
+        int filled;     // frames in the ring
+        uint8_t counts[9][COLOR_COUNT];
+        float labSum[9][COLOR_COUNT][3];    // per color, so a mean can be taken over the winning votes only
+        bool committed;
+        uint8_t committedColors[9];
+    };
+
+    /*
+     * Sticker of the sample that lands on `index` after turning the sample `rotation` quarter turns clockwise.
+     */
+    static int rotatedIndex(int index, int rotation) {
+        int row = index / 3, col = index % 3;
+        for (int k = 0; k < rotation; k++) {
+            int r = row;
+            row = 2 - col;
+            col = r;
+        }
+        return row * 3 + col;
+    }
+
+    int vote(int face, const FaceSample &sample, int rotation) {
+        FaceVotes &f = faces[face];
+        int slot = f.head;
+
+        // the oldest frame leaves the ring
+        if (f.filled == HISTORY) {
+            for (int s = 0; s < 9; s++) {
+                int c = f.ringColors[slot][s];
+                f.counts[s][c]--;
+                for (int k = 0; k < 3; k++) f.labSum[s][c][k] -= f.ringLab[slot][s][k];
+            }
+        } else {
+            f.filled++;
+        }
+
+        for (int s = 0; s < 9; s++) {
+            int from = rotatedIndex(s, rotation);
+            int c = sample.colors[from];
+            f.ringColors[slot][s] = (uint8_t) c;
+            f.counts[s][c]++;
+            for (int k = 0; k < 3; k++) {
+                f.ringLab[slot][s][k] = sample.lab[from][k];
+                f.labSum[s][c][k] += sample.lab[from][k];
+            }
+        }
+        f.head = (slot + 1) % HISTORY;
+
+        // commit once every sticker has a clear winner
+        uint8_t winners[9];
+        for (int s = 0; s < 9; s++) {
+            int best = 0;
+            for (int c = 1; c < COLOR_COUNT; c++)
+                if (f.counts[s][c] > f.counts[s][best]) best = c;
+            if (f.counts[s][best] < VOTE_THRESHOLD || f.counts[s][best] < MIN_AGREEMENT * f.filled) return 0;
+            winners[s] = (uint8_t) best;
+        }
+        if (f.committed && std::memcmp(winners, f.committedColors, sizeof(winners)) == 0) return 0;
+        std::memcpy(f.committedColors, winners, sizeof(winners));
+        f.committed = true;
+        return 1;
+    }
+
+    FaceVotes faces[POSE_FACE_COUNT];
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <UTIL/MappedFile.cpp>
+#include <VISION/FrameSource.cpp>
+
+/*
+ * Recording container: a RecordingFileHeader followed by one record per frame. Each record is a RecordHeader and the raw
+ * pixels of the frame, padded so that every record starts on a RECORD_ALIGN boundary. Frames keep their own size
+ * and type, the governor may change the resolution in the middle of a recording.
+ *
+ * The file is only ever appended to. frameCount in the file header is bumped once a record is fully written, so
+ * a recording cut short by a crash still replays up to its last complete frame.
+ */
+static const char RECORDING_MAGIC[4] = {'R', 'C', 'F', 'R'};
+static const uint32_t RECORDING_VERSION = 1;
+static const size_t RECORD_ALIGN = 64;
+
+struct RecordingFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t frameCount;
+    uint64_t bytesUsed;
+    uint8_t reserved[40];
+};
+
+struct RecordHeader {
+    uint64_t payloadBytes;
+    int64_t index;
+    double captureMs;       // steady clock at capture
+    int32_t width;
+    int32_t height;
+    int32_t type;           // OpenCV type of the pixels
+    uint32_t rowBytes;
+    uint8_t reserved[24];
+};
+
+static_assert(sizeof(RecordingFileHeader) == RECORD_ALIGN, "file header must keep records aligned");
+static_assert(sizeof(RecordHeader) == RECORD_ALIGN, "record header must keep pixels aligned");
+
+inline size_t alignRecord(size_t bytes) {
+    return (bytes + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+/*
+ * Why a record with `available` bytes after its header cannot be replayed, NULL if it can: its pixels must be a valid
+ * image lying entirely within its payload, and its payload within the file.
+ */
+inline const char *recordProblem(const RecordHeader &record, size_t available) {
+    if (record.payloadBytes > available) return "payload past the end of the file";
+    if (record.width <= 0 || record.height <= 0) return "empty image";
+    if ((record.type & ~CV_MAT_TYPE_MASK) != 0 || CV_MAT_DEPTH(record.type) > CV_64F) return "unknown pixel type";
+    uint64_t pixelBytes = (uint64_t) CV_ELEM_SIZE(record.type);
+    if ((uint64_t) record.width * pixelBytes > record.rowBytes || record.rowBytes % CV_ELEM_SIZE1(record.type) != 0)
+        return "bad row size";
+    if ((uint64_t) record.rowBytes * (uint64_t) record.height > record.payloadBytes) return "pixels past the payload";
+    return NULL;
+}
+
+/*
+ * Appends captured frames to a recording.
+ */
+class FrameRecorder {
+public:
+    bool open(const std::string &path) {
+        if (!file.create(path, INITIAL_CAPACITY)) {
+            std::cerr << "ERROR! Unable to create recording " << path << "\n";
+            return false;
+        }
+        RecordingFileHeader header = {};
+        std::memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+        header.version = RECORDING_VERSION;
+        header.bytesUsed = sizeof(RecordingFileHeader);
+        std::memcpy(file.data(), &header, sizeof(header));
+        file.setLength(header.bytesUsed);
+        return true;
+    }
+
+    bool append(const Frame &frame) {
+        if (!file.isOpen() || frame.image.empty()) return false;
+
+        const cv::Mat &image = frame.image;
+        size_t rowBytes = image.cols * image.elemSize();
+        size_t payload = rowBytes * image.rows;
+        size_t offset = header()->bytesUsed;
+        size_t end = offset + alignRecord(sizeof(RecordHeader) + payload);
+        if (!file.reserve(end)) {
+            std::cerr << "ERROR! Recording is full, stopped recording\n";
+            file.close();
+            return false;
+        }
+
+        RecordHeader record = {};
+        record.payloadBytes = payload;
+        record.index = frame.index;
+        record.captureMs = frame.captureMs;
+        record.width = image.cols;
+        record.height = image.rows;
+        record.type = image.type();
+        record.rowBytes = (uint32_t) rowBytes;
+        unsigned char *dst = file.data() + offset;
+        std::memcpy(dst, &record, sizeof(record));
+        dst += sizeof(record);
+        if (image.isContinuous()) {
+            std::memcpy(dst, image.ptr(), payload);
+        } else {
+            for (int y = 0; y < image.rows; y++) {
+                std::memcpy(dst + y * rowBytes, image.ptr(y), rowBytes);
+            }
+        }
+
+        // commit the record
+        header()->bytesUsed = end;
+        header()->frameCount++;
+        file.setLength(end);
+        return true;
+    }
+
+    void close() { file.close(); }
+
+private:
+    static const size_t INITIAL_CAPACITY = 64u << 20;
+
+    RecordingFileHeader *header() { return (RecordingFileHeader *) file.data(); }
+
+    MappedFile file;
+};
+
+/*
+ * Frame source that records every frame it reads from another source. It owns that source.
+ */
+class RecordingSource : public FrameSource {
+public:
+    RecordingSource(FrameSource *source, FrameRecorder *frameRecorder) : inner(source), recorder(frameRecorder) {}
+    ~RecordingSource() override { delete inner; }
+
+    RecordingSource(const RecordingSource &) = delete;
+    RecordingSource &operator=(const RecordingSource &) = delete;
+
+    bool read(Frame &frame) override {
+        if (!inner->read(frame)) return false;
+        recorder->append(frame);
+        return true;
+    }
+
+    void setResolution(int width, int height) override { inner->setResolution(width, height); }
+    bool finished() const override { return inner->finished(); }
+
+private:
+    FrameSource *inner;
+    FrameRecorder *recorder;
+};
+
+/*
+ * Plays a recording back. Frames point straight into the mapped file, nothing is copied. Pixels are mapped
+ * copy-on-write so a stage writing into its input cannot corrupt the recording.
+ */
+class ReplaySource : public FrameSource {
+public:
+    /*
+     * realtime: wait between frames as long as they were apart when recorded, otherwise deliver them as fast as
+     * they are read.
+     */
+    explicit ReplaySource(bool realtime) : paced(realtime) {}
+
+    bool open(const std::string &path) {
+        if (!file.openRead(path) || file.size() < sizeof(RecordingFileHeader)) {
+            std::cerr << "ERROR! Unable to open recording " << path << "\n";
+            return false;
+        }
+        const RecordingFileHeader *header = (const RecordingFileHeader *) file.data();
+        if (std::memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0
+            || header->version != RECORDING_VERSION) {
+            std::cerr << "ERROR! " << path << " is not a recording this version can read\n";
+            file.close();
+            return false;
+        }
+
+        // index the records, stopping at the last committed one or at a damaged one, past which nothing can be found
+        size_t offset = sizeof(RecordingFileHeader);
+        size_t end = std::min<size_t>(header->bytesUsed, file.size());
+        for (uint64_t i = 0; i < header->frameCount && offset + sizeof(RecordHeader) <= end; i++) {
+            const RecordHeader *record = (const RecordHeader *) (file.data() + offset);
+            const char *problem = recordProblem(*record, end - offset - sizeof(RecordHeader));
+            if (problem != NULL) {
+                std::cerr << "ERROR! " << path << ": frame " << i << " is damaged (" << problem << "), replaying the "
+                          << records.size() << " frames before it\n";
+                break;
+            }
+            size_t next = std::min(end, offset + alignRecord(sizeof(RecordHeader) + record->payloadBytes));
+            records.push_back(offset);
+            offset = next;
+        }
+        std::cout << "Replaying " << records.size() << " frames from " << path << std::endl;
+        return true;
+    }
+
+    bool read(Frame &frame) override {
+        if (next >= records.size()) return false;
+        RecordHeader *record = (RecordHeader *) (file.data() + records[next]);
+
+        if (paced) {
+            double now = nowMs();
+            if (next == 0) {
+                startMs = now;
+                firstCaptureMs = record->captureMs;
+            }
+            double dueMs = startMs + (record->captureMs - firstCaptureMs);
+            if (dueMs > now) {
+                std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(dueMs - now));
+            }
+        }
+
+        frame.image = cv::Mat(record->height, record->width, record->type, (unsigned char *) (record + 1),
+                              record->rowBytes);
+        frame.index = record->index;
+        frame.captureMs = nowMs();
+        frame.driverTimestamp = false;
+        next++;
+        return true;
+    }
+
+    // a recording has the resolution it was recorded at
+    void setResolution(int, int) override {}
+
+    bool finished() const override { return next >= records.size(); }
+
+private:
+    MappedFile file;
+    std::vector<size_t> records;    // offset of each record
+    size_t next = 0;
+    bool paced;
+    double startMs = 0.0;
+    double firstCaptureMs = 0.0;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+/*
+ * Milliseconds on the steady clock. Every timestamp carried by a frame uses this clock so they can be subtracted.
+ */
+inline double nowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * A captured image and the moment it was captured.
+ */
+struct Frame {
+    cv::Mat image;
+    long index = -1;            // sequence number assigned by the source
+    double captureMs = 0.0;     // capture time on the steady clock
+    bool driverTimestamp = false;   // true if captureMs comes from the driver rather than from us
+};
+
+/*
+ * Where the frames of the render loop come from.
+ */
+class FrameSource {
+public:
+    virtual ~FrameSource() {}
+
+    /*
+     * Read the next frame, returns false when no frame could be read.
+     */
+    virtual bool read(Frame &frame) = 0;
+
+    /*
+     * Ask for a new frame size. Sources are free to pick the closest size they support.
+     */
+    virtual void setResolution(int width, int height) = 0;
+
+    /*
+     * True once a finite source (a recording) has delivered its last frame.
+     */
+    virtual bool finished() const { return false; }
+};
+
+/*
+ * Frames from a camera through OpenCV.
+ */
+class CameraSource : public FrameSource {
+public:
+    explicit CameraSource(cv::VideoCapture *capture) : cap(capture) {}
+
+    bool read(Frame &frame) override {
+        if (!cap->grab()) {
+            return false;
+        }
+        double hostMs = nowMs();
+        if (!cap->retrieve(frame.image)) {
+            return false;
+        }
+
+        // V4L2 and AVFoundation report the buffer timestamp through POS_MSEC. It is only usable if it uses the
+        // same clock as ours, which we accept when it lands shortly before the moment grab() returned.
+        double driverMs = cap->get(cv::CAP_PROP_POS_MSEC);
+        frame.driverTimestamp = driverMs > 0.0 && driverMs <= hostMs && hostMs - driverMs < MAX_DRIVER_LAG_MS;
+        frame.captureMs = frame.driverTimestamp ? driverMs : hostMs;
+        frame.index = frames++;
+        return true;
+    }
+
+    void setResolution(int width, int height) override {
+        cap->set(cv::CAP_PROP_FRAME_WIDTH, width);
+        cap->set(cv::CAP_PROP_FRAME_HEIGHT, height);
+    }
+
+private:
+    static constexpr double MAX_DRIVER_LAG_MS = 1000.0;
+
+    cv::VideoCapture *cap;
+    long frames = 0;
+};
+
+/*
+ * Frame counter encoding shared by the synthetic source and the readback decoder: the low COUNTER_BITS bits of the
+ * frame index are drawn as a row of blocks along the top edge, most significant bit first. A set bit is a fine
+ * checkerboard which survives the edge filter of imageProcessing(), a cleared bit is flat.
+ */
+static const int COUNTER_BITS = 16;
+static const int COUNTER_BLOCK = 32;
+static const int COUNTER_CHECKER = 8;
+
+/*
+ * Generated frames carrying their own index, used to measure latency without a camera.
+ */
+class SyntheticSource : public FrameSource {
+public:
+    SyntheticSource(int width, int height) : size(width, height) {}
+
+    bool read(Frame &frame) override {
+        frame.image.create(size, CV_8UC3);
+        frame.image = cv::Scalar(64, 64, 64);
+
+        // a moving bar so the picture is not static
+        int x = (int) (frames * 4 % size.width);
+        cv::rectangle(frame.image, cv::Rect(x, size.height / 2, 40, 40), cv::Scalar(0, 200, 255), cv::FILLED);
+
+        for (int bit = 0; bit < COUNTER_BITS; bit++) {
+            if (!((frames >> (COUNTER_BITS - 1 - bit)) & 1)) continue;
+            for (int y = 0; y < COUNTER_BLOCK; y += COUNTER_CHECKER) {
+                for (int cx = 0; cx < COUNTER_BLOCK; cx += COUNTER_CHECKER) {
+                    if (((y + cx) / COUNTER_CHECKER) % 2) continue;
+                    cv::Rect cell(bit * COUNTER_BLOCK + cx, y, COUNTER_CHECKER, COUNTER_CHECKER);
+                    cv::rectangle(frame.image, cell, cv::Scalar(255, 255, 255), cv::FILLED);
+                }
+            }
+        }
+
+        frame.index = frames++;
+        frame.captureMs = nowMs();
+        frame.driverTimestamp = false;
+        return true;
+    }
+
+    void setResolution(int width, int height) override {
+        // the counter strip needs COUNTER_BITS blocks on one row
+        size = cv::Size(std::max(width, COUNTER_BITS * COUNTER_BLOCK), std::max(height, 2 * COUNTER_BLOCK));
+    }
+
+private:
+    cv::Size size;
+    long frames = 0;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+ * One face of the cube found in an image.
+ */
+struct FaceGrid {
+    cv::Point2f corners[4];     // outer corners, clockwise in the image, starting at the corner of sticker 0
+    cv::Point2f centers[9];     // sticker centers, row by row
+};
+
+/*
+ * Finds a 3x3 grid of stickers: square-ish contours of similar size, indexed on a common lattice and fitted with a
+ * homography so that missing or badly segmented stickers are filled in from the straight grid lines.
+ */
+class GridDetector {
+public:
+    /*
+     * Look for a face in `image` (BGR). Points are returned in the coordinates of `image`.
+     */
+    bool detect(const cv::Mat &image, FaceGrid &grid) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        cv::Canny(gray, edges, 20, 60);
+        cv::dilate(edges, edges, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)));
+
+        std::vector<Quad> quads;
+        findQuads(image.cols * image.rows, quads);
+        if (quads.size() < MIN_STICKERS) return false;
+        return fitGrid(quads, grid);
+    }
+
+private:
+    static const size_t MIN_STICKERS = 5;
+
+    struct Quad {
+        cv::Point2f center;
+        cv::Point2f points[4];
+        float side;
+    };
+
+    void findQuads(int imageArea, std::vector<Quad> &quads) {
+        contours.clear();
+        cv::findContours(edges, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+
+        std::vector<cv::Point> polygon;
+        for (size_t i = 0; i < contours.size(); i++) {
+            double area = cv::contourArea(contours[i]);
+            if (area < imageArea * 0.0006 || area > imageArea * 0.05) continue;
+
+            cv::approxPolyDP(contours[i], polygon, 0.1 * cv::arcLength(contours[i], true), true);
+            if (polygon.size() != 4 || !cv::isContourConvex(polygon)) continue;
+
+            // squares only: sides of similar length and an area close to side^2
+            float minSide = 1e9f, maxSide = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                cv::Point d = polygon[(k + 1) % 4] - polygon[k];
+                float len = std::sqrt((float) (d.x * d.x + d.y * d.y));
+                minSide = std::min(minSide, len);
+                maxSide = std::max(maxSide, len);
+            }
+            if (maxSide > 1.6f * minSide) continue;
+            float side = (float) std::sqrt(area);
+            if (area < 0.6 * maxSide * maxSide) continue;
+
+            Quad quad;
+            quad.center = cv::Point2f(0.0f, 0.0f);
+            for (int k = 0; k < 4; k++) {
+                quad.points[k] = cv::Point2f((float) polygon[k].x, (float) polygon[k].y);
+                quad.center += quad.points[k] * 0.25;
+            }
+            quad.side = side;
+
+            // the inner and outer contour of a dilated edge describe the same sticker
+            bool duplicate = false;
+            for (size_t q = 0; q < quads.size() && !duplicate; q++) {
+                cv::Point2f d = quads[q].center - quad.center;
+                duplicate = d.dot(d) < 0.25f * side * side;
+            }
+            if (!duplicate) quads.push_back(quad);
+        }
+    }
+
+    bool fitGrid(std::vector<Quad> &quads, FaceGrid &grid) {
+        // stickers of one face have about the same size
+        std::vector<float> sides;
+        for (size_t i = 0; i < quads.size(); i++) sides.push_back(quads[i].side);
+        std::nth_element(sides.begin(), sides.begin() + sides.size() / 2, sides.end());
+        float medianSide = sides[sides.size() / 2];
+        std::vector<Quad> stickers;
+        for (size_t i = 0; i < quads.size(); i++) {
+            if (quads[i].side > 0.6f * medianSide && quads[i].side < 1.6f * medianSide) stickers.push_back(quads[i]);
+        }
+        if (stickers.size() < MIN_STICKERS) return false;
+
+        // dominant edge direction, folded modulo 90 degrees
+        double sx = 0.0, sy = 0.0;
+        for (size_t i = 0; i < stickers.size(); i++) {
+            for (int k = 0; k < 4; k++) {
+                cv::Point2f d = stickers[i].points[(k + 1) % 4] - stickers[i].points[k];
+                double a = 4.0 * std::atan2(d.y, d.x);
+                sx += std::cos(a);
+                sy += std::sin(a);
+            }
+        }
+        double angle = std::atan2(sy, sx) / 4.0;
+        cv::Point2f u((float) std::cos(angle), (float) std::sin(angle));
+        cv::Point2f v(-u.y, u.x);
+
+        // distance between neighbouring stickers
+        std::vector<float> gaps;
+        for (size_t i = 0; i < stickers.size(); i++) {
+            float best = 1e9f;
+            for (size_t j = 0; j < stickers.size(); j++) {
+                if (i == j) continue;
+                cv::Point2f d = stickers[j].center - stickers[i].center;
+                best = std::min(best, std::sqrt(d.dot(d)));
+            }
+            gaps.push_back(best);
+        }
+        std::nth_element(gaps.begin(), gaps.begin() + gaps.size() / 2, gaps.end());
+        float pitch = gaps[gaps.size() / 2];
+
+        // Put every sticker on the lattice around each candidate seed and keep the best 3x3 window
+        int bestCount = 0;
+        std::vector<cv::Point2f> bestGrid, bestImage;
+        for (size_t s = 0; s < stickers.size(); s++) {
+            int cell[5][5];
+            int count[5][5] = {};
+            for (size_t i = 0; i < stickers.size(); i++) {
+                cv::Point2f d = stickers[i].center - stickers[s].center;
+                float gx = d.dot(u) / pitch, gy = d.dot(v) / pitch;
+                int ix = (int) std::lround(gx), iy = (int) std::lround(gy);
+                if (std::abs(ix) > 2 || std::abs(iy) > 2) continue;
+                if (std::fabs(gx - ix) > 0.3f || std::fabs(gy - iy) > 0.3f) continue;
+                count[iy + 2][ix + 2]++;
+                cell[iy + 2][ix + 2] = (int) i;
+            }
+            for (int oy = 0; oy <= 2; oy++) {
+                for (int ox = 0; ox <= 2; ox++) {
+                    int n = 0;
+                    for (int y = 0; y < 3; y++)
+                        for (int x = 0; x < 3; x++)
+                            n += count[oy + y][ox + x] == 1;
+                    if (n <= bestCount) continue;
+                    bestCount = n;
+                    bestGrid.clear();
+                    bestImage.clear();
+                    for (int y = 0; y < 3; y++) {
+                        for (int x = 0; x < 3; x++) {
+                            if (count[oy + y][ox + x] != 1) continue;
+                            bestGrid.push_back(cv::Point2f(x + 0.5f, y + 0.5f));
+                            bestImage.push_back(stickers[cell[oy + y][ox + x]].center);
+                        }
+                    }
+                }
+            }
+        }
+        if (bestCount < (int) MIN_STICKERS) return false;
+
+        // straight grid lines through the stickers found
+        cv::Mat h = cv::findHomography(bestGrid, bestImage);
+        if (h.empty()) return false;
+
+        std::vector<cv::Point2f> lattice, projected;
+        lattice.push_back(cv::Point2f(0.0f, 0.0f));
+        lattice.push_back(cv::Point2f(3.0f, 0.0f));
+        lattice.push_back(cv::Point2f(3.0f, 3.0f));
+        lattice.push_back(cv::Point2f(0.0f, 3.0f));
+        for (int y = 0; y < 3; y++)
+            for (int x = 0; x < 3; x++)
+                lattice.push_back(cv::Point2f(x + 0.5f, y + 0.5f));
+        cv::perspectiveTransform(lattice, projected, h);
+
+        for (int k = 0; k < 4; k++) grid.corners[k] = projected[k];
+        for (int k = 0; k < 9; k++) grid.centers[k] = projected[4 + k];
+
+        // u and v form a right-handed basis in image coordinates (y down), so the corners come out clockwise
+        return true;
+    }
+
+    cv::Mat gray;
+    cv::Mat edges;
+    std::vector<std::vector<cv::Point> > contours;
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <VISION/FrameSource.cpp>
+
+/*
+ * Timestamps of one frame on its way from the camera to the screen.
+ */
+struct FrameStamp {
+    long index = -1;
+    double captureMs = 0.0;
+    double processedMs = 0.0;   // end of imageProcessing()
+    bool driverTimestamp = false;
+    cv::Size frameSize;         // size of the captured image
+};
+
+/*
+ * Collects capture-to-present latencies and reports their distribution.
+ *
+ * Two ways to attribute a presented frame to its capture: the stamp carried through imageProcessing() and render(),
+ * or, with the synthetic source, the frame counter decoded from the framebuffer right before the swap. The readback
+ * also catches frames shown twice or never, which the carried stamp cannot see.
+ */
+class LatencyHarness {
+public:
+    explicit LatencyHarness(double reportEveryMs = 5000.0) : reportEvery(reportEveryMs), captures(1 << COUNTER_BITS, -1.0) {
+        lastReport = nowMs();
+    }
+
+    /*
+     * Remember when a frame was captured so a decoded counter can be mapped back to it.
+     */
+    void captured(const Frame &frame) {
+        captures[frame.index & ((1 << COUNTER_BITS) - 1)] = frame.captureMs;
+        if (frame.driverTimestamp) driverStamps++;
+    }
+
+    /*
+     * A frame went through swap buffers at presentMs.
+     */
+    void presented(const FrameStamp &stamp, double presentMs) {
+        if (stamp.index < 0) return;
+        captureToProcessed.push_back(stamp.processedMs - stamp.captureMs);
+        processedToPresent.push_back(presentMs - stamp.processedMs);
+        captureToPresent.push_back(presentMs - stamp.captureMs);
+        maybeReport(presentMs);
+    }
+
+    /*
+     * The pose of a tracked cube was refined in `ms`, which should stay under TRACKED_POSE_BUDGET_MS.
+     */
+    void trackedPoseSolved(double ms) {
+        trackedPose.push_back(ms);
+        if (ms > TRACKED_POSE_BUDGET_MS) trackedPoseOver++;
+    }
+
+    /*
+     * A frame whose counter was read back from the framebuffer went through swap buffers at presentMs.
+     */
+    void presentedDecoded(long counter, double presentMs) {
+        if (counter < 0) {
+            undecoded++;
+            return;
+        }
+        double captureMs = captures[counter];
+        if (captureMs < 0.0) {
+            undecoded++;
+            return;
+        }
+        if (counter == lastDecoded) repeated++;
+        lastDecoded = counter;
+        readback.push_back(presentMs - captureMs);
+        maybeReport(presentMs);
+    }
+
+    /*
+     * Decode the synthetic frame counter from the current (back) framebuffer. frameSize is the size of the image
+     * stretched over the whole viewport. Returns -1 if no counter is visible.
+     */
+    long decodeCounter(int fbWidth, int fbHeight, cv::Size frameSize) {
+        double sx = (double) fbWidth / frameSize.width;
+        double sy = (double) fbHeight / frameSize.height;
+        int blockW = (int) (COUNTER_BLOCK * sx);
+        int stripH = (int) (COUNTER_BLOCK * sy);
+        if (blockW < 4 || stripH < 4) return -1;
+
+        // The image is drawn upright so its top rows are the top of the framebuffer
+        int stripW = blockW * COUNTER_BITS;
+        pixels.resize((size_t) stripW * stripH * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, fbHeight - stripH, stripW, stripH, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+        long counter = 0;
+        for (int bit = 0; bit < COUNTER_BITS; bit++) {
+            // only look at the inner half of the block, its borders touch the neighbours
+            long sum = 0, count = 0;
+            for (int y = stripH / 4; y < stripH * 3 / 4; y++) {
+                for (int x = bit * blockW + blockW / 4; x < bit * blockW + blockW * 3 / 4; x++) {
+                    const unsigned char *p = &pixels[((size_t) y * stripW + x) * 3];
+                    sum += p[0] + p[1] + p[2];
+                    count += 3;
+                }
+            }
+            counter = (counter << 1) | (sum > count * SET_BIT_THRESHOLD ? 1 : 0);
+        }
+        return counter;
+    }
+
+    /*
+     * Print the distributions collected since the last report.
+     */
+    void report() {
+        std::cout << "[latency] ";
+        if (!captureToPresent.empty()) {
+            printDistribution("capture->processed", captureToProcessed);
+            printDistribution(" processed->present", processedToPresent);
+            printDistribution(" capture->present", captureToPresent);
+            std::cout << " (" << (driverStamps > 0 ? "driver" : "host") << " timestamps)";
+        }
+        if (!readback.empty() || undecoded > 0) {
+            printDistribution("readback capture->present", readback);
+            std::cout << " repeated " << repeated << " undecoded " << undecoded;
+        }
+        if (!trackedPose.empty()) {
+            printDistribution(" tracked pose", trackedPose);
+            std::cout << " over " << TRACKED_POSE_BUDGET_MS << " ms " << trackedPoseOver;
+        }
+        std::cout << std::endl;
+
+        captureToProcessed.clear();
+        processedToPresent.clear();
+        captureToPresent.clear();
+        readback.clear();
+        trackedPose.clear();
+        repeated = undecoded = driverStamps = trackedPoseOver = 0;
+    }
+
+private:
+    // mean channel value over a block above which the bit is set. Flat blocks come out of the edge filter near 0.
+    static const int SET_BIT_THRESHOLD = 10;
+    static constexpr double TRACKED_POSE_BUDGET_MS = 1.0;
+
+    void maybeReport(double now) {
+        if (now - lastReport >= reportEvery) {
+            report();
+            lastReport = now;
+        }
+    }
+
+    static void printDistribution(const char *name, std::vector<double> &samples) {
+        if (samples.empty()) {
+            std::cout << name << " n=0";
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        std::cout << name << " n=" << samples.size()
+                  << " p50=" << percentile(samples, 0.50)
+                  << " p90=" << percentile(samples, 0.90)
+                  << " p99=" << percentile(samples, 0.99)
+                  << " max=" << samples.back() << " ms";
+    }
+
+    static double percentile(const std::vector<double> &sorted, double p) {
+        size_t i = (size_t) (p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(i, sorted.size() - 1)];
+    }
+
+    double reportEvery;
+    double lastReport;
+    std::vector<double> captures;   // capture time by counter value, -1 if unknown
+    std::vector<double> captureToProcessed;
+    std::vector<double> processedToPresent;
+    std::vector<double> captureToPresent;
+    std::vector<double> readback;
+    std::vector<double> trackedPose;    // pose solve times on the tracked path
+    std::vector<unsigned char> pixels;
+    long lastDecoded = -1;
+    long repeated = 0;
+    long undecoded = 0;
+    long driverStamps = 0;
+    long trackedPoseOver = 0;
+};
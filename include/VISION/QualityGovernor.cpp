@@ -0,0 +1,243 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+/*
+ * Stages of one iteration of the render loop, in the order they run. Capture is mostly waiting for the camera's next
+ * frame and present for the display's next refresh (or, when latency is measured, for the GPU), so both are measured
+ * but not counted against the budget.
+ */
+enum Stage {
+    STAGE_CAPTURE = 0,
+    STAGE_PROCESS,
+    STAGE_DETECT,
+    STAGE_UPLOAD,
+    STAGE_RENDER,
+    STAGE_PRESENT,
+    STAGE_COUNT
+};
+
+static const char *stageNames[STAGE_COUNT] = {"capture", "process", "detect", "upload", "render", "present"};
+
+/*
+ * The knobs the governor can turn. Each knob has a ladder of settings ordered from best quality to cheapest.
+ */
+enum Knob {
+    KNOB_RESOLUTION = 0,
+    KNOB_SCALE,
+    KNOB_DETECT_EVERY,
+    KNOB_COUNT
+};
+
+struct Resolution {
+    int width;
+    int height;
+};
+
+static const Resolution resolutionLadder[] = {{1280, 720}, {960, 540}, {640, 480}, {320, 240}};
+static const double scaleLadder[] = {1.0, 0.75, 0.5, 0.35};
+static const int detectEveryLadder[] = {1, 2, 3, 4, 6};
+
+/*
+ * Current quality settings, as read by the stages of the loop.
+ */
+struct QualityLevel {
+    int captureWidth;
+    int captureHeight;
+    double processScale;    // scale applied to the captured frame before processing
+    int detectEvery;        // detection runs on every Nth frame only
+};
+
+/*
+ * Keeps the loop in main() within a frame-time budget.
+ *
+ * Every stage reports its cost through stageDone(); endFrame() smooths the frame time without the waits and,
+ * when it stays over (or well under) budget for long enough, steps the knob of the most expensive stage down (or
+ * undoes the last step). A camera-paced loop therefore fits the budget of its own frame rate, and the loop starts at
+ * the best quality and only leaves it when the work does not fit. Separate thresholds, hold counts and a cooldown
+ * after every change provide the hysteresis.
+ */
+class QualityGovernor {
+public:
+    explicit QualityGovernor(double targetFrameMs) : targetMs(targetFrameMs) {
+        for (int i = 0; i < STAGE_COUNT; i++) stageMs[i] = 0.0;
+        for (int i = 0; i < KNOB_COUNT; i++) rung[i] = 0;
+        lastMark = Clock::now();
+    }
+
+    void beginFrame() {
+        frameStart = lastMark = Clock::now();
+        waitMs = 0.0;
+    }
+
+    /*
+     * Record the time spent since the previous mark as the cost of the given stage.
+     */
+    void stageDone(Stage stage) {
+        Clock::time_point now = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - lastMark).count();
+        stageMs[stage] = stageMs[stage] * (1.0 - SMOOTHING) + ms * SMOOTHING;
+        if (isWait(stage)) waitMs += ms;
+        lastMark = now;
+    }
+
+    /*
+     * Close the frame and adjust the quality if needed. Returns true if the level changed.
+     */
+    bool endFrame() {
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count() - waitMs;
+        frameMs = frames == 0 ? ms : frameMs * (1.0 - SMOOTHING) + ms * SMOOTHING;
+        frames++;
+
+        if (cooldown > 0) {
+            cooldown--;
+            return false;
+        }
+
+        overBudget = frameMs > targetMs * DOWNGRADE_RATIO ? overBudget + 1 : 0;
+        underBudget = frameMs < targetMs * UPGRADE_RATIO ? underBudget + 1 : 0;
+        if (overBudget == 0) exhausted = false;
+
+        if (overBudget >= DOWNGRADE_HOLD) return downgrade();
+        if (underBudget >= UPGRADE_HOLD && !history.empty()) return upgrade();
+        return false;
+    }
+
+    /*
+     * Detection only runs on every Nth frame when the governor is saving time.
+     */
+    bool shouldDetect() const {
+        return (frames % level().detectEvery) == 0;
+    }
+
+    QualityLevel level() const {
+        QualityLevel l;
+        l.captureWidth = resolutionLadder[rung[KNOB_RESOLUTION]].width;
+        l.captureHeight = resolutionLadder[rung[KNOB_RESOLUTION]].height;
+        l.processScale = scaleLadder[rung[KNOB_SCALE]];
+        l.detectEvery = detectEveryLadder[rung[KNOB_DETECT_EVERY]];
+        return l;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static constexpr double SMOOTHING = 0.1;
+    static constexpr double DOWNGRADE_RATIO = 1.10;
+    static constexpr double UPGRADE_RATIO = 0.70;
+    static const int DOWNGRADE_HOLD = 15;
+    static const int UPGRADE_HOLD = 90;
+    static const int COOLDOWN = 30;
+
+    static int ladderSize(int knob) {
+        switch (knob) {
+            case KNOB_RESOLUTION: return sizeof(resolutionLadder) / sizeof(resolutionLadder[0]);
+            case KNOB_SCALE: return sizeof(scaleLadder) / sizeof(scaleLadder[0]);
+            default: return sizeof(detectEveryLadder) / sizeof(detectEveryLadder[0]);
+        }
+    }
+
+    static bool isWait(int stage) {
+        return stage == STAGE_CAPTURE || stage == STAGE_PRESENT;
+    }
+
+    /*
+     * The knob that makes a given stage cheaper, -1 for none. Upload cost follows the capture resolution, render
+     * cost is not under our control so it falls back to the capture resolution as well. The waits are not ours to
+     * cut: a smaller frame arrives no sooner and the display refreshes no sooner.
+     */
+    static int knobForStage(int stage) {
+        if (isWait(stage)) return -1;
+        switch (stage) {
+            case STAGE_PROCESS: return KNOB_SCALE;
+            case STAGE_DETECT: return KNOB_DETECT_EVERY;
+            default: return KNOB_RESOLUTION;
+        }
+    }
+
+    bool downgrade() {
+        // Sort the stages from most to least expensive and step the first knob that still has room
+        std::vector<int> order;
+        for (int i = 0; i < STAGE_COUNT; i++) order.push_back(i);
+        for (size_t i = 0; i < order.size(); i++)
+            for (size_t j = i + 1; j < order.size(); j++)
+                if (stageMs[order[j]] > stageMs[order[i]]) std::swap(order[i], order[j]);
+
+        for (size_t i = 0; i < order.size(); i++) {
+            int knob = knobForStage(order[i]);
+            if (knob < 0 || rung[knob] + 1 >= ladderSize(knob)) continue;
+
+            QualityLevel before = level();
+            rung[knob]++;
+            history.push_back(knob);
+            log("over budget", order[i], knob, before);
+            resetCounters();
+            return true;
+        }
+
+        // said once until the frames fit again
+        if (!exhausted) {
+            std::cout << "[governor] " << frameMs << " ms over the " << targetMs
+                      << " ms budget but every knob is already at its cheapest setting" << std::endl;
+            exhausted = true;
+        }
+        resetCounters();
+        return false;
+    }
+
+    bool upgrade() {
+        // Undo the most recent downgrade first, it was the last one needed to fit the budget
+        int knob = history.back();
+        history.pop_back();
+
+        QualityLevel before = level();
+        rung[knob]--;
+        log("under budget", -1, knob, before);
+        resetCounters();
+        return true;
+    }
+
+    void resetCounters() {
+        overBudget = underBudget = 0;
+        cooldown = COOLDOWN;
+    }
+
+    void log(const char *reason, int stage, int knob, const QualityLevel &before) const {
+        QualityLevel after = level();
+        std::cout << "[governor] frame " << frames << ": " << reason << " (" << frameMs << " ms, budget "
+                  << targetMs << " ms";
+        if (stage >= 0) {
+            std::cout << ", " << stageNames[stage] << " " << stageMs[stage] << " ms";
+        }
+        std::cout << ") -> ";
+        switch (knob) {
+            case KNOB_RESOLUTION:
+                std::cout << "capture " << before.captureWidth << "x" << before.captureHeight << " -> "
+                          << after.captureWidth << "x" << after.captureHeight;
+                break;
+            case KNOB_SCALE:
+                std::cout << "process scale " << before.processScale << " -> " << after.processScale;
+                break;
+            default:
+                std::cout << "detect every " << before.detectEvery << " -> " << after.detectEvery << " frames";
+                break;
+        }
+        std::cout << std::endl;
+    }
+
+    double targetMs;
+    double frameMs = 0.0;       // smoothed, without the capture wait
+    double waitMs = 0.0;        // capture and present waits of the current frame
+    double stageMs[STAGE_COUNT];
+    int rung[KNOB_COUNT];
+    std::vector<int> history;
+    long frames = 0;
+    int overBudget = 0;
+    int underBudget = 0;
+    int cooldown = 0;
+    bool exhausted = false;     // over budget with every knob at its cheapest
+    Clock::time_point frameStart;
+    Clock::time_point lastMark;
+};
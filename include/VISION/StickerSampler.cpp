@@ -0,0 +1,207 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include <VISION/CubeTracker.cpp>
+
+/*
+ * Sticker colors of a standard cube.
+ */
+enum StickerColor {
+    COLOR_WHITE = 0,
+    COLOR_YELLOW,
+    COLOR_RED,
+    COLOR_ORANGE,
+    COLOR_BLUE,
+    COLOR_GREEN,
+    COLOR_COUNT
+};
+
+static const char stickerColorNames[COLOR_COUNT] = {'W', 'Y', 'R', 'O', 'B', 'G'};
+
+// BGR, for drawing
+static const cv::Scalar stickerColorBgr[COLOR_COUNT] = {
+        cv::Scalar(255, 255, 255), cv::Scalar(0, 255, 255), cv::Scalar(0, 0, 255),
+        cv::Scalar(0, 128, 255), cv::Scalar(255, 0, 0), cv::Scalar(0, 200, 0)};
+
+// Lab (L in 0..100) of each color under neutral light, the starting point of the classifier
+static const float stickerColorLab[COLOR_COUNT][3] = {
+        {95.0f, 0.0f, 2.0f}, {88.0f, -8.0f, 80.0f}, {45.0f, 65.0f, 45.0f},
+        {65.0f, 45.0f, 70.0f}, {35.0f, 15.0f, -55.0f}, {55.0f, -55.0f, 40.0f}};
+
+/*
+ * Faces of the cube relative to the tracked face (F), in the order U R F D L B.
+ */
+enum PoseFace {
+    POSE_U = 0,
+    POSE_R,
+    POSE_F,
+    POSE_D,
+    POSE_L,
+    POSE_B,
+    POSE_FACE_COUNT
+};
+
+/*
+ * The nine stickers of one face as seen in one frame, row by row as the face is looked at from outside with the
+ * usual net orientation (U seen from above with F at the bottom, D seen from below with F at the top, the side
+ * faces with U at the top).
+ */
+struct FaceSample {
+    int face = POSE_F;
+    cv::Vec3f lab[9];
+    int colors[9];
+};
+
+/*
+ * Turns faces found in an image into sticker colors. Both paths, one face from the grid detector or up to three
+ * faces projected from the cube pose, go through the same two stages:
+ *  - rectification: the face quad is warped to a small square, one cell per sticker;
+ *  - classification: the mean Lab of the middle of each cell is matched to the nearest sticker color.
+ */
+class StickerSampler {
+public:
+    StickerSampler() {
+        for (int c = 0; c < COLOR_COUNT; c++)
+            palette[c] = cv::Vec3f(stickerColorLab[c][0], stickerColorLab[c][1], stickerColorLab[c][2]);
+    }
+
+    /*
+     * Sample the face whose outer corners (clockwise from the corner of sticker 0) are given.
+     */
+    void sampleFace(const cv::Mat &image, const cv::Point2f corners[4], FaceSample &sample) {
+        rectify(image, corners);
+        classify(sample);
+    }
+
+    /*
+     * Sample a single face straight from the detector.
+     */
+    void sampleFace(const cv::Mat &image, const FaceGrid &grid, FaceSample &sample) {
+        sample.face = POSE_F;
+        sampleFace(image, grid.corners, sample);
+    }
+
+    /*
+     * Sample every face turned towards the camera for the given pose: up to three faces, 27 stickers, in one
+     * frame. K and dist describe `image`.
+     */
+    void sampleVisibleFaces(const cv::Mat &image, const CubePose &pose, double cubeSize, const cv::Mat &K,
+                            const cv::Mat &dist, std::vector<FaceSample> &samples) {
+        samples.clear();
+        if (!pose.valid) return;
+
+        cv::Mat R;
+        cv::Rodrigues(pose.rvec, R);
+        // camera center in cube coordinates: -R^T t
+        cv::Mat rt = R.t() * pose.tvec;
+        double eye[3] = {-rt.at<double>(0), -rt.at<double>(1), -rt.at<double>(2)};
+        double eyeDistance = std::sqrt(eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2]);
+        double h = 0.5 * cubeSize;
+
+        std::vector<cv::Point3f> corners;
+        std::vector<cv::Point2f> projected;
+        for (int face = 0; face < POSE_FACE_COUNT; face++) {
+            // the face is visible if the camera is in front of its plane, with some margin against grazing views
+            const int *n = faceNormals[face];
+            double distance = n[0] * eye[0] + n[1] * eye[1] + n[2] * eye[2] - h;
+            if (distance < MIN_VIEW_COSINE * eyeDistance) continue;
+
+            corners.clear();
+            for (int k = 0; k < 4; k++) {
+                const int *c = faceCorners[face][k];
+                corners.push_back(cv::Point3f((float) (c[0] * h), (float) (c[1] * h), (float) (c[2] * h)));
+            }
+            cv::projectPoints(corners, pose.rvec, pose.tvec, K, dist, projected);
+
+            FaceSample sample;
+            sample.face = face;
+            sampleFace(image, &projected[0], sample);
+            samples.push_back(sample);
+        }
+    }
+
+    /*
+     * Nearest palette color of a Lab value. Lightness counts half, it varies most with the lighting.
+     */
+    int classify(const cv::Vec3f &lab) const {
+        int best = 0;
+        float bestDistance = 1e30f;
+        for (int c = 0; c < COLOR_COUNT; c++) {
+            float dl = 0.5f * (lab[0] - palette[c][0]), da = lab[1] - palette[c][1], db = lab[2] - palette[c][2];
+            float d = dl * dl + da * da + db * db;
+            if (d < bestDistance) {
+                bestDistance = d;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    /*
+     * Sticker centers of a face in cube coordinates, in sample order.
+     */
+    static void stickerCenters(int face, double cubeSize, std::vector<cv::Point3f> &centers) {
+        double h = 0.5 * cubeSize;
+        const int *tl = faceCorners[face][0], *tr = faceCorners[face][1], *bl = faceCorners[face][3];
+        centers.clear();
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++) {
+                double u = (col + 0.5) / 3.0, v = (row + 0.5) / 3.0;
+                float p[3];
+                for (int i = 0; i < 3; i++) p[i] = (float) (h * (tl[i] + u * (tr[i] - tl[i]) + v * (bl[i] - tl[i])));
+                centers.push_back(cv::Point3f(p[0], p[1], p[2]));
+            }
+        }
+    }
+
+private:
+    static const int CELL = 20;
+    static constexpr double MIN_VIEW_COSINE = 0.15;
+
+    // outward normal of each face in cube coordinates (y down, z away from the camera for the tracked face)
+    static constexpr int faceNormals[POSE_FACE_COUNT][3] = {
+            {0, -1, 0}, {1, 0, 0}, {0, 0, -1}, {0, 1, 0}, {-1, 0, 0}, {0, 0, 1}};
+
+    // corners of each face in units of half the cube size: top left, top right, bottom right, bottom left
+    static constexpr int faceCorners[POSE_FACE_COUNT][4][3] = {
+            {{-1, -1, 1}, {1, -1, 1}, {1, -1, -1}, {-1, -1, -1}},       // U: B edge at the top
+            {{1, -1, -1}, {1, -1, 1}, {1, 1, 1}, {1, 1, -1}},           // R: F edge on the left
+            {{-1, -1, -1}, {1, -1, -1}, {1, 1, -1}, {-1, 1, -1}},       // F: the tracked face
+            {{-1, 1, -1}, {1, 1, -1}, {1, 1, 1}, {-1, 1, 1}},           // D: F edge at the top
+            {{-1, -1, 1}, {-1, -1, -1}, {-1, 1, -1}, {-1, 1, 1}},       // L: B edge on the left
+            {{1, -1, 1}, {-1, -1, 1}, {-1, 1, 1}, {1, 1, 1}}};          // B: R edge on the left
+
+    void rectify(const cv::Mat &image, const cv::Point2f corners[4]) {
+        const float side = 3.0f * CELL;
+        cv::Point2f square[4] = {cv::Point2f(0.0f, 0.0f), cv::Point2f(side, 0.0f), cv::Point2f(side, side),
+                                 cv::Point2f(0.0f, side)};
+        cv::Mat h = cv::getPerspectiveTransform(corners, square);
+        cv::warpPerspective(image, rectified, h, cv::Size(3 * CELL, 3 * CELL), cv::INTER_LINEAR);
+        rectified.convertTo(rectifiedFloat, CV_32FC3, 1.0 / 255.0);
+        cv::cvtColor(rectifiedFloat, rectifiedLab, cv::COLOR_BGR2Lab);
+    }
+
+    void classify(FaceSample &sample) {
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++) {
+                // the middle half of the cell, away from the black borders and the reflections on the edges
+                cv::Rect cell(col * CELL + CELL / 4, row * CELL + CELL / 4, CELL / 2, CELL / 2);
+                cv::Scalar mean = cv::mean(rectifiedLab(cell));
+                cv::Vec3f lab((float) mean[0], (float) mean[1], (float) mean[2]);
+                sample.lab[row * 3 + col] = lab;
+                sample.colors[row * 3 + col] = classify(lab);
+            }
+        }
+    }
+
+    cv::Vec3f palette[COLOR_COUNT];
+    cv::Mat rectified;
+    cv::Mat rectifiedFloat;
+    cv::Mat rectifiedLab;
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <VISION/FrameRecorder.cpp>
+
+/*
+ * Pinhole model and distortion coefficients of a camera, as produced by calibrateFromRecording().
+ */
+struct CameraIntrinsics {
+    cv::Mat cameraMatrix;
+    cv::Mat distCoeffs;
+    cv::Size imageSize;     // resolution the calibration was made at
+
+    bool load(const std::string &path) {
+        cv::FileStorage fs(path, cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            std::cerr << "ERROR! Unable to open intrinsics " << path << "\n";
+            return false;
+        }
+        fs["camera_matrix"] >> cameraMatrix;
+        fs["distortion_coefficients"] >> distCoeffs;
+        fs["image_width"] >> imageSize.width;
+        fs["image_height"] >> imageSize.height;
+        if (cameraMatrix.empty() || distCoeffs.empty() || imageSize.width <= 0 || imageSize.height <= 0) {
+            std::cerr << "ERROR! " << path << " does not contain camera intrinsics\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool save(const std::string &path) const {
+        cv::FileStorage fs(path, cv::FileStorage::WRITE);
+        if (!fs.isOpened()) {
+            std::cerr << "ERROR! Unable to write intrinsics " << path << "\n";
+            return false;
+        }
+        fs << "image_width" << imageSize.width;
+        fs << "image_height" << imageSize.height;
+        fs << "camera_matrix" << cameraMatrix;
+        fs << "distortion_coefficients" << distCoeffs;
+        return true;
+    }
+
+    /*
+     * Camera matrix for another resolution of the same sensor. Webcams scale rather than crop, so the focal
+     * lengths and the principal point scale with the image.
+     */
+    cv::Mat cameraMatrixFor(cv::Size size) const {
+        cv::Mat k = cameraMatrix.clone();
+        double sx = (double) size.width / imageSize.width;
+        double sy = (double) size.height / imageSize.height;
+        k.at<double>(0, 0) *= sx;
+        k.at<double>(0, 2) *= sx;
+        k.at<double>(1, 1) *= sy;
+        k.at<double>(1, 2) *= sy;
+        return k;
+    }
+};
+
+/*
+ * Removes lens distortion with remap tables computed once per frame size.
+ *
+ * The CPU path uses OpenCV's fixed-point maps (CV_16SC2 + interpolation table) and only remaps the region the
+ * detector looks at. The GPU path uploads a normalised float map that background.frag samples through, so the
+ * displayed image is undistorted for the cost of one extra texture fetch per pixel.
+ */
+class Undistorter {
+public:
+    explicit Undistorter(const CameraIntrinsics &cameraIntrinsics) : intrinsics(cameraIntrinsics) {}
+
+    /*
+     * Compute the maps for this frame size if they are not already. Cheap when nothing changed.
+     */
+    void prepare(cv::Size size) {
+        if (size.width == mapSize.width && size.height == mapSize.height) return;
+        mapSize = size;
+        camera = intrinsics.cameraMatrixFor(size);
+        cv::initUndistortRectifyMap(camera, intrinsics.distCoeffs, cv::Mat(), camera, size, CV_16SC2, fixedMap,
+                                    interpolationMap);
+        gpuMapDirty = true;
+    }
+
+    /*
+     * Undistort the part `roi` of `src` (in undistorted coordinates) into `dst`, which gets the size of the roi.
+     */
+    void applyRoi(const cv::Mat &src, cv::Mat &dst, cv::Rect roi) {
+        prepare(src.size());
+        roi = roi & cv::Rect(0, 0, src.cols, src.rows);
+        if (roi.empty()) {
+            dst.release();
+            return;
+        }
+        cv::remap(src, dst, fixedMap(roi), interpolationMap(roi), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    }
+
+    /*
+     * Camera matrix of the undistorted image at the prepared size.
+     */
+    const cv::Mat &cameraMatrix() const { return camera; }
+
+    const CameraIntrinsics &cameraIntrinsics() const { return intrinsics; }
+
+    /*
+     * Upload the map for the background shader to `texture` (an RG32F texture), if it changed since the last
+     * upload. The map is stored in texture orientation: it turns the texture coordinate of a displayed pixel into
+     * the texture coordinate to sample in the flipped, distorted camera texture.
+     */
+    void uploadShaderMap(GLuint texture) {
+        if (!gpuMapDirty) return;
+        gpuMapDirty = false;
+
+        cv::Mat map, unused;
+        cv::initUndistortRectifyMap(camera, intrinsics.distCoeffs, cv::Mat(), camera, mapSize, CV_32FC2, map, unused);
+
+        cv::Mat normalized(mapSize, CV_32FC2);
+        for (int y = 0; y < mapSize.height; y++) {
+            // texture row y shows image row height - 1 - y
+            const float *in = map.ptr<float>(mapSize.height - 1 - y);
+            float *out = normalized.ptr<float>(y);
+            for (int x = 0; x < mapSize.width; x++) {
+                out[2 * x] = (in[2 * x] + 0.5f) / mapSize.width;
+                out[2 * x + 1] = 1.0f - (in[2 * x + 1] + 0.5f) / mapSize.height;
+            }
+        }
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, mapSize.width, mapSize.height, 0, GL_RG, GL_FLOAT, normalized.ptr());
+    }
+
+private:
+    CameraIntrinsics intrinsics;
+    cv::Size mapSize;
+    cv::Mat camera;
+    cv::Mat fixedMap;           // integer source coordinates
+    cv::Mat interpolationMap;   // index into OpenCV's bilinear weight table
+    bool gpuMapDirty = false;
+};
+
+/*
+ * Compute camera intrinsics from a recording of a checkerboard with `boardSize` inner corners and squares of
+ * `squareSize` (any unit). Frames are sampled every `frameStep` frames so consecutive, nearly identical views do not
+ * dominate. Returns false if the board was not seen often enough.
+ */
+bool calibrateFromRecording(const std::string &recordingPath, cv::Size boardSize, double squareSize,
+                            CameraIntrinsics &intrinsics, int frameStep = 10) {
+    ReplaySource replay(false);
+    if (!replay.open(recordingPath)) {
+        return false;
+    }
+
+    std::vector<cv::Point3f> board;
+    for (int y = 0; y < boardSize.height; y++) {
+        for (int x = 0; x < boardSize.width; x++) {
+            board.push_back(cv::Point3f((float) (x * squareSize), (float) (y * squareSize), 0.0f));
+        }
+    }
+
+    std::vector<std::vector<cv::Point3f> > objectPoints;
+    std::vector<std::vector<cv::Point2f> > imagePoints;
+    cv::Size imageSize;
+    Frame frame;
+    for (long i = 0; replay.read(frame); i++) {
+        if (i % frameStep != 0) continue;
+        if (imageSize.width == 0) {
+            imageSize = frame.image.size();
+        } else if (frame.image.cols != imageSize.width || frame.image.rows != imageSize.height) {
+            // the resolution changed during the recording, only one can be calibrated
+            continue;
+        }
+
+        cv::Mat gray;
+        cv::cvtColor(frame.image, gray, cv::COLOR_BGR2GRAY);
+        std::vector<cv::Point2f> corners;
+        if (!cv::findChessboardCorners(gray, boardSize, corners,
+                                       cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE)) {
+            continue;
+        }
+        cv::cornerSubPix(gray, corners, cv::Size(11, 11), cv::Size(-1, -1),
+                         cv::TermCriteria(cv::TermCriteria::EPS | cv::TermCriteria::COUNT, 30, 0.01));
+        objectPoints.push_back(board);
+        imagePoints.push_back(corners);
+    }
+
+    const size_t MIN_VIEWS = 10;
+    std::cout << "Checkerboard found in " << imagePoints.size() << " frames" << std::endl;
+    if (imagePoints.size() < MIN_VIEWS) {
+        std::cerr << "ERROR! At least " << MIN_VIEWS << " views of the checkerboard are needed\n";
+        return false;
+    }
+
+    std::vector<cv::Mat> rvecs, tvecs;
+    intrinsics.imageSize = imageSize;
+    double rms = cv::calibrateCamera(objectPoints, imagePoints, imageSize, intrinsics.cameraMatrix,
+                                     intrinsics.distCoeffs, rvecs, tvecs);
+    std::cout << "Calibration RMS reprojection error: " << rms << " px" << std::endl;
+    return true;
+}
@@ -0,0 +1,281 @@
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <CUBE/CubeState.cpp>
+#include <CUBE/FaceletCube.cpp>
+#include <SOLVER/KorfSolver.cpp>
+#include <SOLVER/TwoPhaseSolver.cpp>
+#include <UTIL/MappedFile.cpp>
+#include <UTIL/WorkStealingPool.cpp>
+
+/*
+ * Headless batch solver: reads cubes from a file, solves them on all cores and writes one line per cube, in input
+ * order, as soon as the cubes before it are done.
+ *
+ * Input is either text, one cube per line as a facelet string or as the moves that scramble it from solved (empty
+ * lines and lines starting with # are skipped), or binary: CUBE_FILE_MAGIC, then per cube the two words of a
+ * CubeState, corners first, little-endian. An output line is the solution, "ERROR: <reason>" for a cube that cannot
+ * be solved or "NOT FOUND" when the budget ran out.
+ */
+static const char CUBE_FILE_MAGIC[8] = {'R', 'C', 'S', 'T', 'A', 'T', 'E', '1'};
+static const size_t CHUNK = 16;     // cubes per task
+
+struct BatchCube {
+    CubeState cube = CubeState::solved();
+    const char *error = NULL;   // why the input line is not a cube that can be solved
+};
+
+static uint64_t readLittleEndian(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static void writeLittleEndian(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static bool readCubes(const std::string &path, std::vector<BatchCube> &cubes) {
+    MappedFile file;
+    if (file.openReadOnly(path, true) && file.size() >= sizeof(CUBE_FILE_MAGIC)
+        && std::memcmp(file.data(), CUBE_FILE_MAGIC, sizeof(CUBE_FILE_MAGIC)) == 0) {
+        size_t count = (file.size() - sizeof(CUBE_FILE_MAGIC)) / 16;
+        cubes.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            const unsigned char *p = file.data() + sizeof(CUBE_FILE_MAGIC) + 16 * i;
+            cubes[i].cube.corners = readLittleEndian(p);
+            cubes[i].cube.edges = readLittleEndian(p + 8);
+            cubes[i].error = cubes[i].cube.verify();
+        }
+        return true;
+    }
+    file.close();
+
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "ERROR! Unable to read " << path << "\n";
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t begin = line.find_first_not_of(" \t\r"), end = line.find_last_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') continue;
+        line = line.substr(begin, end - begin + 1);
+
+        BatchCube c;
+        std::vector<int> scramble;
+        if (line.size() == (size_t) FACELET_COUNT && line.find(' ') == std::string::npos) {
+            c.error = CubeState::fromFacelets(line, c.cube);
+            if (!c.error) c.error = c.cube.verify();
+        } else if (parseMoves(line, scramble)) {
+            c.cube = CubeState::solved().moves(scramble);
+        } else {
+            c.error = "neither a facelet string nor a move sequence";
+        }
+        cubes.push_back(c);
+    }
+    return true;
+}
+
+static bool writeBinary(const std::string &path, const std::vector<BatchCube> &cubes) {
+    MappedFile file;
+    size_t bytes = sizeof(CUBE_FILE_MAGIC) + 16 * cubes.size();
+    if (!file.create(path, bytes)) {
+        std::cerr << "ERROR! Unable to create " << path << "\n";
+        return false;
+    }
+    std::memcpy(file.data(), CUBE_FILE_MAGIC, sizeof(CUBE_FILE_MAGIC));
+    for (size_t i = 0; i < cubes.size(); i++) {
+        // a line that is no cube stays in place as words that are none either
+        unsigned char *p = file.data() + sizeof(CUBE_FILE_MAGIC) + 16 * i;
+        writeLittleEndian(p, cubes[i].error ? 0 : cubes[i].cube.corners);
+        writeLittleEndian(p + 8, cubes[i].error ? 0 : cubes[i].cube.edges);
+    }
+    file.setLength(bytes);
+    return true;
+}
+
+static double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    std::string inputPath;
+    std::string outputPath;             // solutions, standard output when empty
+    std::string binaryPath;             // write the cubes read in the binary format
+    long randomCount = 0;               // solve that many random cubes instead of reading a file
+    bool optimal = false;               // Korf's solver instead of the two-phase one
+    int threads = 0;                    // 0 for one per core
+    SolveOptions options;
+    std::string tablesPath = "twophase.tables";
+    std::string korfTablesPath = "korf.tables";
+    int edgePieces = KorfTables::MIN_EDGE_PIECES;
+    bool modulo3 = false;
+    size_t endgameBudget = 0;           // memory for the endgame table, 0 for none
+    std::string endgameTablesPath = "endgame.tables";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--save-binary" && i + 1 < argc) {
+            binaryPath = argv[++i];
+        } else if (arg == "--random" && i + 1 < argc) {
+            randomCount = std::atol(argv[++i]);
+        } else if (arg == "--optimal") {
+            optimal = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "--max-length" && i + 1 < argc) {
+            options.maxLength = std::atoi(argv[++i]);
+        } else if (arg == "--timeout-ms" && i + 1 < argc) {
+            options.timeoutMs = std::atof(argv[++i]);
+        } else if (arg == "--orientations" && i + 1 < argc) {
+            options.orientations = std::atoi(argv[++i]);
+        } else if (arg == "--tables" && i + 1 < argc) {
+            tablesPath = argv[++i];
+        } else if (arg == "--korf-tables" && i + 1 < argc) {
+            korfTablesPath = argv[++i];
+        } else if (arg == "--edge-pieces" && i + 1 < argc) {
+            edgePieces = std::atoi(argv[++i]);
+        } else if (arg == "--modulo3") {
+            modulo3 = true;
+        } else if (arg == "--endgame-mb" && i + 1 < argc) {
+            endgameBudget = (size_t) std::atol(argv[++i]) << 20;
+        } else if (arg == "--endgame-tables" && i + 1 < argc) {
+            endgameTablesPath = argv[++i];
+        } else if (arg[0] != '-' && inputPath.empty()) {
+            inputPath = arg;
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            inputPath.clear();
+            randomCount = 0;
+            break;
+        }
+    }
+    if (inputPath.empty() == (randomCount <= 0)) {
+        std::cerr << "Usage: batch (<cube file> | --random <count>) [--output <file>] [--save-binary <file>] "
+                     "[--threads <count>] [--max-length <moves>] [--timeout-ms <ms>] [--orientations <1-6>] "
+                     "[--tables <file>] [--endgame-mb <MB> [--endgame-tables <file>]] "
+                     "[--optimal [--korf-tables <file>] [--edge-pieces <6|7>] [--modulo3]]\n";
+        return -1;
+    }
+    if (options.orientations < 1 || options.orientations > 6) {
+        std::cerr << "--orientations takes 1 to 6\n";
+        return -1;
+    }
+    if (edgePieces < KorfTables::MIN_EDGE_PIECES || edgePieces > KorfTables::MAX_EDGE_PIECES) {
+        std::cerr << "--edge-pieces takes " << KorfTables::MIN_EDGE_PIECES << " to " << KorfTables::MAX_EDGE_PIECES
+                  << "\n";
+        return -1;
+    }
+
+    std::vector<BatchCube> cubes;
+    if (randomCount > 0) {
+        std::mt19937 rng(1);
+        cubes.resize(randomCount);
+        for (BatchCube &c : cubes) c.cube = CubeState::random(rng);
+    } else if (!readCubes(inputPath, cubes)) {
+        return -1;
+    }
+    if (!binaryPath.empty() && !writeBinary(binaryPath, cubes)) return -1;
+
+    FILE *out = stdout;
+    if (!outputPath.empty() && !(out = std::fopen(outputPath.c_str(), "w"))) {
+        std::cerr << "ERROR! Unable to write " << outputPath << "\n";
+        return -1;
+    }
+
+    TwoPhaseTables twoPhaseTables;
+    KorfTables korfTables;
+    if (optimal) korfTables.loadOrBuild(korfTablesPath, edgePieces, modulo3, TableLoadOptions());
+    else twoPhaseTables.loadOrBuild(tablesPath, TableLoadOptions());
+    EndgameTable endgame;
+    if (EndgameTable::depthFor(endgameBudget) > 0) {
+        endgame.loadOrBuild(endgameTablesPath, EndgameTable::depthFor(endgameBudget), TableLoadOptions());
+        options.endgame = &endgame;
+    }
+
+    WorkStealingPool pool(threads);
+    std::vector<std::unique_ptr<TwoPhaseSolver>> twoPhaseSolvers;
+    std::vector<std::unique_ptr<KorfSolver>> korfSolvers;
+    for (int w = 0; w < pool.threads(); w++) {
+        if (optimal) korfSolvers.emplace_back(new KorfSolver(korfTables));
+        else twoPhaseSolvers.emplace_back(new TwoPhaseSolver(twoPhaseTables));
+    }
+    options.threads = 1;
+
+    // results are written in order: a finished chunk writes every line that no unfinished one precedes
+    std::vector<Solution> solutions(cubes.size());
+    std::vector<char> done(cubes.size(), 0);
+    size_t written = 0;
+    std::mutex outputLock;
+
+    double cpuStart = cpuSeconds();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t first = 0; first < cubes.size(); first += CHUNK) {
+        pool.submit([&, first](int worker) {
+            size_t end = std::min(first + CHUNK, cubes.size());
+            for (size_t i = first; i < end; i++) {
+                if (cubes[i].error) continue;
+                if (optimal) korfSolvers[worker]->solve(cubes[i].cube, options, solutions[i]);
+                else twoPhaseSolvers[worker]->solve(cubes[i].cube, options, solutions[i]);
+            }
+
+            std::lock_guard<std::mutex> lock(outputLock);
+            for (size_t i = first; i < end; i++) done[i] = 1;
+            for (; written < cubes.size() && done[written]; written++) {
+                if (cubes[written].error) std::fprintf(out, "ERROR: %s\n", cubes[written].error);
+                else if (!solutions[written].found) std::fprintf(out, "NOT FOUND\n");
+                else std::fprintf(out, "%s\n", formatMoves(solutions[written].moves).c_str());
+            }
+        });
+    }
+    pool.wait();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = cpuSeconds() - cpuStart;
+    if (out != stdout) std::fclose(out);
+    else std::fflush(out);
+
+    size_t solved = 0, timedOut = 0, invalid = 0, wrong = 0;
+    double lengthSum = 0.0;
+    int lengths[32] = {0};
+    for (size_t i = 0; i < cubes.size(); i++) {
+        if (!cubes[i].error && solutions[i].timedOut) timedOut++;
+        if (cubes[i].error) {
+            invalid++;
+        } else if (solutions[i].found) {
+            if (!verifySolution(cubes[i].cube.toFacelets(), solutions[i].moves)) wrong++;
+            solved++;
+            lengthSum += (double) solutions[i].moves.size();
+            lengths[std::min<size_t>(31, solutions[i].moves.size())]++;
+        }
+    }
+    // a solve that timed out may still have found a solution, just not one within the budget
+    std::cerr << "[batch] " << cubes.size() << " cubes, " << solved << " solved, " << timedOut << " timed out, "
+              << cubes.size() - solved - invalid << " not found, " << invalid << " invalid, " << wrong
+              << " wrong, " << (optimal ? "optimal" : "two-phase") << " solver on " << pool.threads()
+              << " thread" << (pool.threads() > 1 ? "s" : "") << std::endl;
+    std::cerr << "[batch] " << wallSeconds << " s, " << solved / std::max(wallSeconds, 1e-9) << " solves/s, cpu "
+              << cpu << " s (" << cpu / std::max(wallSeconds, 1e-9) << " cores busy)" << std::endl;
+    std::cerr << "[batch] length: mean " << lengthSum / std::max<size_t>(1, solved) << ",";
+    for (int l = 0; l < 32; l++)
+        if (lengths[l]) std::cerr << " " << l << ":" << lengths[l];
+    std::cerr << std::endl;
+    return wrong ? 1 : 0;
+}
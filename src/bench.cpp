@@ -0,0 +1,785 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <vector>
+
+#include <CUBE/CubeState.cpp>
+#include <CUBE/FaceletCube.cpp>
+#include <SOLVER/KorfSolver.cpp>
+#include <SOLVER/SolutionCache.cpp>
+#include <SOLVER/TwoPhaseSolver.cpp>
+
+/*
+ * Microbenchmarks of the cube model and the solver, one subcommand each.
+ */
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Moves applied per second, over a long random sequence without immediate repetition of a face.
+ */
+static int benchMoves(int argc, char **argv) {
+    long count = argc > 0 ? std::atol(argv[0]) : 100000000L;
+    std::mt19937 rng(1);
+    std::vector<uint8_t> sequence(1 << 16);
+    int last = -1;
+    for (size_t i = 0; i < sequence.size(); i++) {
+        int m;
+        do m = (int) (rng() % MOVE_COUNT); while (last >= 0 && moveFace(m) == moveFace(last));
+        sequence[i] = (uint8_t) m;
+        last = m;
+    }
+
+    CubeState s = CubeState::solved();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++) s = s.move(sequence[i & (sequence.size() - 1)]);
+    double seconds = secondsSince(start);
+
+    // the final state keeps the loop from being optimized away
+    std::cout << "moves: " << count << " in " << seconds << " s, " << count / seconds / 1e6 << " M moves/s ("
+              << (s.verify() ? "invalid" : "valid") << " final state)" << std::endl;
+
+    CubeState a = CubeState::solved();
+    CubeState b = CubeState::random(rng);
+    long products = count / 10;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < products; i++) a = a * b;
+    seconds = secondsSince(start);
+    std::cout << "multiply: " << products << " in " << seconds << " s, " << products / seconds / 1e6
+              << " M products/s (" << (a.verify() ? "invalid" : "valid") << " final state)" << std::endl;
+    return 0;
+}
+
+/*
+ * Facelet moves per second for every implementation this CPU runs, each checked against the cubie model.
+ */
+static int benchFacelets(int argc, char **argv) {
+    long count = argc > 0 ? std::atol(argv[0]) : 100000000L;
+    std::mt19937 rng(1);
+    std::vector<uint8_t> sequence(1 << 16);
+    for (size_t i = 0; i < sequence.size(); i++) sequence[i] = (uint8_t) (rng() % MOVE_COUNT);
+
+    CubeState reference = CubeState::solved();
+    long rounds = (count + (long) sequence.size() - 1) / (long) sequence.size();
+    for (long r = 0; r < rounds; r++)
+        for (size_t i = 0; i < sequence.size(); i++) reference = reference.move(sequence[i]);
+    FaceletCube expected = FaceletCube::fromString(reference.toFacelets());
+
+    int status = 0;
+    std::vector<FaceletMovesImplementation> implementations = faceletMovesImplementations();
+    for (const FaceletMovesImplementation &impl : implementations) {
+        FaceletCube cube = FaceletCube::solved();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (long r = 0; r < rounds; r++) impl.apply(cube, sequence.data(), sequence.size());
+        double seconds = secondsSince(start);
+        bool agrees = cube == expected;
+        if (!agrees) status = 1;
+        std::cout << "facelets " << impl.name << ": " << rounds * (long) sequence.size() / seconds / 1e6
+                  << " M moves/s, " << (agrees ? "agrees with" : "DIFFERS FROM") << " the cubie model" << std::endl;
+    }
+    return status;
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t) (p * values.size()))];
+}
+
+/*
+ * Two-phase solve time and solution length over a fixed set of random cubes, every solution verified, searching in
+ * `orientations` orientations at once. The tables come from the given file, built and written there if needed, or
+ * are built in memory.
+ */
+static int benchTwoPhase(int argc, char **argv) {
+    int count = argc > 0 ? std::atoi(argv[0]) : 1000;
+    SolveOptions options;
+    if (argc > 1) options.maxLength = std::atoi(argv[1]);
+    if (argc > 2) options.timeoutMs = std::atof(argv[2]);
+    if (argc > 4) options.orientations = std::atoi(argv[4]);
+
+    static TwoPhaseTables tables;
+    tables.loadOrBuild(argc > 3 ? argv[3] : "", TableLoadOptions());
+
+    TwoPhaseSolver solver(tables);
+    std::mt19937 rng(2024);
+    std::vector<double> times;
+    int lengths[32] = {}, failed = 0, timedOut = 0, wrong = 0;
+    double lengthSum = 0.0;
+    for (int i = 0; i < count; i++) {
+        CubeState cube = CubeState::random(rng);
+        Solution solution;
+        bool found = solver.solve(cube, options, solution);
+        times.push_back(solution.solveMs);
+        if (solution.timedOut) timedOut++;
+        if (!found) {
+            failed++;
+            continue;
+        }
+        if (!verifySolution(cube.toFacelets(), solution.moves)) wrong++;
+        lengths[solution.moves.size()]++;
+        lengthSum += (double) solution.moves.size();
+    }
+
+    double total = 0.0;
+    for (double t : times) total += t;
+    std::cout << "twophase: " << count << " cubes, max length " << options.maxLength << ", timeout "
+              << options.timeoutMs << " ms, " << options.orientations << " orientation"
+              << (options.orientations > 1 ? "s" : "") << std::endl;
+    std::cout << "  time: mean " << total / count << " ms, p50 " << percentile(times, 0.5) << " ms, p99 "
+              << percentile(times, 0.99) << " ms, max " << percentile(times, 1.0) << " ms" << std::endl;
+    std::cout << "  length: mean " << lengthSum / std::max(1, count - failed) << ",";
+    for (int l = 0; l < 32; l++)
+        if (lengths[l]) std::cout << " " << l << ":" << lengths[l];
+    std::cout << std::endl;
+    std::cout << "  timed out " << timedOut << ", not found " << failed << ", wrong " << wrong << std::endl;
+    return wrong ? 1 : 0;
+}
+
+/*
+ * Time to get the two-phase tables ready: built in memory on one thread and on all cores (the tables must come out
+ * the same), then mapped from a file with and without prefaulting.
+ */
+static int benchTables(int argc, char **argv) {
+    std::string path = argc > 0 ? argv[0] : "twophase.tables";
+    int threads = argc > 1 ? std::atoi(argv[1]) : (int) std::max(1u, std::thread::hardware_concurrency());
+    std::remove(path.c_str());
+    uint64_t checksum[2];
+    for (int run = 0; run < 2; run++) {
+        int t = run == 0 ? 1 : threads;
+        TwoPhaseTables tables;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        PruningTable::FillStats stats = tables.build(t, argc > 2);
+        double seconds = secondsSince(start);
+        checksum[run] = tableChecksum(tables.moves.data(), CoordinateMoves::entries() * sizeof(uint16_t))
+                        ^ tableChecksum(tables.flipSliceTwist.data(), tables.flipSliceTwist.bytes())
+                        ^ tableChecksum(tables.cornerSlice.data(), tables.cornerSlice.bytes())
+                        ^ tableChecksum(tables.edgeSlice.data(), tables.edgeSlice.bytes());
+        std::cout << "tables built on " << t << " thread" << (t > 1 ? "s" : "") << ": " << seconds * 1000.0
+                  << " ms, pruning tables " << stats.states / stats.seconds / 1e6 << " M states/s, checksum "
+                  << std::hex << checksum[run] << std::dec << std::endl;
+        if (run == 1 && !tables.save(path)) return 1;
+    }
+    if (checksum[0] != checksum[1]) {
+        std::cerr << "ERROR! Tables differ with the number of threads\n";
+        return 1;
+    }
+    const char *modes[3] = {"prefault + verify", "prefault", "lazy"};
+    for (int mode = 0; mode < 3; mode++) {
+        TableLoadOptions options;
+        options.verify = mode == 0;
+        options.prefault = mode < 2;
+        TwoPhaseTables tables;
+        const char *problem = NULL;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool loaded = tables.load(path, options, &problem);
+        double loadMs = secondsSince(start) * 1000.0;
+        if (!loaded) {
+            std::cerr << "ERROR! " << path << ": " << problem << "\n";
+            return 1;
+        }
+        // first solve, which faults in whatever the lazy mapping has not read yet
+        TwoPhaseSolver solver(tables);
+        std::mt19937 rng(7);
+        Solution solution;
+        start = std::chrono::steady_clock::now();
+        solver.solve(CubeState::random(rng), SolveOptions(), solution);
+        std::cout << "tables " << modes[mode] << ": ready in " << loadMs << " ms, first solve "
+                  << secondsSince(start) * 1000.0 << " ms" << std::endl;
+    }
+    return 0;
+}
+
+/*
+ * Optimal solves of scrambles of a fixed length, on one thread and on `threads` threads: search time, nodes per
+ * second, speedup and solution lengths. With "hugepages" the databases are copied from the file to huge pages
+ * rather than read in place. Random cubes (18 moves and more from solved) take minutes each with these
+ * databases, so the scrambles are kept short.
+ */
+static int benchKorf(int argc, char **argv) {
+    int count = argc > 0 ? std::atoi(argv[0]) : 20;
+    int scrambleLength = argc > 1 ? std::atoi(argv[1]) : 12;
+    int pieces = argc > 2 ? std::atoi(argv[2]) : KorfTables::MIN_EDGE_PIECES;
+    std::string path = argc > 3 ? argv[3] : "korf.tables";
+    int threads = argc > 4 ? std::atoi(argv[4]) : (int) std::max(1u, std::thread::hardware_concurrency());
+    TableLoadOptions loadOptions;
+    loadOptions.hugePages = argc > 5 && std::strcmp(argv[5], "hugepages") == 0;
+    if (pieces < KorfTables::MIN_EDGE_PIECES || pieces > KorfTables::MAX_EDGE_PIECES) {
+        std::cerr << "ERROR! The edge databases take " << KorfTables::MIN_EDGE_PIECES << " to "
+                  << KorfTables::MAX_EDGE_PIECES << " edges\n";
+        return 1;
+    }
+
+    KorfTables tables;
+    tables.loadOrBuild(path, pieces, false, loadOptions);
+    KorfSolver solver(tables);
+    std::cout << "korf: " << count << " scrambles of " << scrambleLength << " moves, " << pieces
+              << "-edge databases, " << tables.bytes() / 1e6 << " MB" << std::endl;
+
+    std::mt19937 rng(3);
+    std::vector<CubeState> cubes;
+    for (int i = 0; i < count; i++) {
+        std::vector<int> scramble;
+        for (int k = 0; k < scrambleLength; k++) {
+            int m;
+            do m = (int) (rng() % MOVE_COUNT);
+            while (!scramble.empty() && moveFace(m) == moveFace(scramble.back()));
+            scramble.push_back(m);
+        }
+        cubes.push_back(CubeState::solved().moves(scramble));
+    }
+
+    int wrong = 0;
+    double singleMs = 0.0;
+    for (int t : {1, threads}) {
+        if (t == 1 && singleMs > 0.0) break;
+        SolveOptions options;
+        options.maxLength = scrambleLength;
+        options.timeoutMs = 1e9;
+        options.threads = t;
+        std::vector<double> times;
+        long nodes = 0;
+        double totalMs = 0.0, lengthSum = 0.0;
+        int lengths[32] = {0};
+        for (const CubeState &cube : cubes) {
+            Solution solution;
+            if (!solver.solve(cube, options, solution) || !verifySolution(cube.toFacelets(), solution.moves)) {
+                wrong++;
+                continue;
+            }
+            times.push_back(solution.solveMs);
+            totalMs += solution.solveMs;
+            nodes += solution.nodes;
+            lengths[solution.moves.size()]++;
+            lengthSum += (double) solution.moves.size();
+        }
+        if (t == 1) singleMs = totalMs;
+
+        size_t solved = std::max<size_t>(1, times.size());
+        std::cout << "  " << t << " thread" << (t > 1 ? "s" : "") << ": mean " << totalMs / solved << " ms, p50 "
+                  << percentile(times, 0.5) << " ms, max " << percentile(times, 1.0) << " ms, "
+                  << nodes / std::max(totalMs, 1e-9) / 1e3 << " M nodes/s, speedup "
+                  << singleMs / std::max(totalMs, 1e-9) << std::endl;
+        std::cout << "    length: mean " << lengthSum / solved << ",";
+        for (int l = 0; l < 32; l++)
+            if (lengths[l]) std::cout << " " << l << ":" << lengths[l];
+        std::cout << std::endl;
+    }
+    std::cout << "  not found or wrong " << wrong << std::endl;
+    return wrong ? 1 : 0;
+}
+
+/*
+ * Corner pattern database with and without the symmetry reduction: size, build time, lookups per second on random
+ * cubes and along a random walk (the access pattern of a search), and a check that both give the same distances.
+ *
+ * Then the two-phase phase 1 tables: the three pairwise slice, twist and flip tables it used to take the largest of,
+ * against the single flip-slice table reduced by symmetry. Their sizes, build times, lookups per second from the
+ * coordinates, as the search has them, and the mean distance each gives, which must never be larger for the pairwise
+ * tables.
+ */
+static int benchSymmetry(int argc, char **argv) {
+    long count = argc > 0 ? std::atol(argv[0]) : 2000000L;
+    static const int allMoves[MOVE_COUNT] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17};
+    CoordinateMoves m;
+    m.build();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PruningTable raw;
+    raw.allocate((size_t) CORNER_PERM_COUNT * TWIST_COUNT);
+    raw.fillBreadthFirst(allMoves, MOVE_COUNT, [&m](size_t i, int move) {
+        size_t corner = i / TWIST_COUNT, twist = i % TWIST_COUNT;
+        return (size_t) m.cornerPerm[corner * MOVE_COUNT + move] * TWIST_COUNT + m.twist[twist * MOVE_COUNT + move];
+    });
+    double rawSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    CornerSymmetryCoordinate symmetry;
+    symmetry.build();
+    PruningTable reduced;
+    reduced.allocate(CornerSymmetryCoordinate::INDEX_COUNT);
+    reduced.fillBreadthFirst(allMoves, MOVE_COUNT, [&m, &symmetry](size_t i, int move) {
+        return symmetry.next(i, move, m);
+    });
+    double reducedSeconds = secondsSince(start);
+
+    std::mt19937 rng(11);
+    std::vector<CubeState> randomCubes(count), walk(count);
+    CubeState s = CubeState::solved();
+    for (long i = 0; i < count; i++) {
+        randomCubes[i] = CubeState::random(rng);
+        s = s.move((int) (rng() % MOVE_COUNT));
+        walk[i] = s;
+    }
+
+    long mismatches = 0;
+    for (const std::vector<CubeState> *cubes : {&randomCubes, &walk})
+        for (const CubeState &c : *cubes)
+            if (raw.get(cornerPatternIndex(c)) != reduced.get(symmetry.index(c))) mismatches++;
+
+    start = std::chrono::steady_clock::now();
+    PruningTable sliceTwist, sliceFlip, twistFlip;
+    sliceTwist.allocate((size_t) SLICE_COUNT * TWIST_COUNT);
+    sliceTwist.fillBreadthFirst(allMoves, MOVE_COUNT, [&m](size_t i, int move) {
+        size_t slice = i / TWIST_COUNT, twist = i % TWIST_COUNT;
+        return (size_t) m.slice[slice * MOVE_COUNT + move] * TWIST_COUNT + m.twist[twist * MOVE_COUNT + move];
+    });
+    sliceFlip.allocate((size_t) SLICE_COUNT * FLIP_COUNT);
+    sliceFlip.fillBreadthFirst(allMoves, MOVE_COUNT, [&m](size_t i, int move) {
+        size_t slice = i / FLIP_COUNT, flip = i % FLIP_COUNT;
+        return (size_t) m.slice[slice * MOVE_COUNT + move] * FLIP_COUNT + m.flip[flip * MOVE_COUNT + move];
+    });
+    twistFlip.allocate((size_t) TWIST_COUNT * FLIP_COUNT);
+    twistFlip.fillBreadthFirst(allMoves, MOVE_COUNT, [&m](size_t i, int move) {
+        size_t twist = i / FLIP_COUNT, flip = i % FLIP_COUNT;
+        return (size_t) m.twist[twist * MOVE_COUNT + move] * FLIP_COUNT + m.flip[flip * MOVE_COUNT + move];
+    });
+    double pairwiseSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    FlipSliceSymmetryCoordinate flipSlice;
+    flipSlice.build();
+    PruningTable flipSliceTwist;
+    flipSliceTwist.allocate(FlipSliceSymmetryCoordinate::INDEX_COUNT);
+    flipSliceTwist.fillBreadthFirst(allMoves, MOVE_COUNT, [&m, &flipSlice](size_t i, int move) {
+        return flipSlice.next(i, move, m);
+    });
+    double flipSliceSeconds = secondsSince(start);
+
+    struct Phase1Coordinates {
+        int slice, twist, flip;
+    };
+    std::vector<Phase1Coordinates> phase1[2];
+    for (int k = 0; k < 2; k++)
+        for (const CubeState &c : k == 0 ? randomCubes : walk)
+            phase1[k].push_back({sliceSortedOf(c) / SLICE_PERM_COUNT, twistOf(c), flipOf(c)});
+    auto pairwiseDistance = [&](const Phase1Coordinates &c) {
+        return std::max(std::max(sliceTwist.get((size_t) c.slice * TWIST_COUNT + c.twist),
+                                 sliceFlip.get((size_t) c.slice * FLIP_COUNT + c.flip)),
+                        twistFlip.get((size_t) c.twist * FLIP_COUNT + c.flip));
+    };
+    auto flipSliceDistance = [&](const Phase1Coordinates &c) {
+        return flipSliceTwist.get(flipSlice.index(c.slice, c.flip, c.twist));
+    };
+    for (int k = 0; k < 2; k++)
+        for (const Phase1Coordinates &c : phase1[k])
+            if (pairwiseDistance(c) > flipSliceDistance(c)) mismatches++;
+
+    std::cout << "corner database: raw " << raw.entries() << " entries, " << raw.bytes() / 1e6 << " MB, built in "
+              << rawSeconds << " s; reduced by " << UD_SYMMETRY_COUNT << " symmetries " << reduced.entries()
+              << " entries, " << reduced.bytes() / 1e6 << " MB, built in " << reducedSeconds << " s" << std::endl;
+    const char *names[2] = {"random cubes", "random walk"};
+    const std::vector<CubeState> *sets[2] = {&randomCubes, &walk};
+    for (int k = 0; k < 2; k++) {
+        long sum = 0;
+        start = std::chrono::steady_clock::now();
+        for (const CubeState &c : *sets[k]) sum += raw.get(cornerPatternIndex(c));
+        double rawRate = count / secondsSince(start);
+        start = std::chrono::steady_clock::now();
+        for (const CubeState &c : *sets[k]) sum += reduced.get(symmetry.index(c));
+        double reducedRate = count / secondsSince(start);
+        std::cout << "  " << names[k] << ": raw " << rawRate / 1e6 << " M lookups/s, reduced " << reducedRate / 1e6
+                  << " M lookups/s (distance sum " << sum << ")" << std::endl;
+    }
+
+    size_t pairwiseEntries = sliceTwist.entries() + sliceFlip.entries() + twistFlip.entries();
+    size_t pairwiseBytes = sliceTwist.bytes() + sliceFlip.bytes() + twistFlip.bytes();
+    std::cout << "phase 1 tables: pairwise " << pairwiseEntries << " entries, " << pairwiseBytes / 1e6
+              << " MB, built in " << pairwiseSeconds << " s; flip-slice reduced by " << UD_SYMMETRY_COUNT
+              << " symmetries " << flipSliceTwist.entries() << " entries, " << flipSliceTwist.bytes() / 1e6
+              << " MB, built in " << flipSliceSeconds << " s (unreduced it would be "
+              << (double) SLICE_COUNT * FLIP_COUNT * TWIST_COUNT / 2 / 1e6 << " MB)" << std::endl;
+    for (int k = 0; k < 2; k++) {
+        long pairwiseSum = 0, flipSliceSum = 0;
+        start = std::chrono::steady_clock::now();
+        for (const Phase1Coordinates &c : phase1[k]) pairwiseSum += pairwiseDistance(c);
+        double pairwiseRate = count / secondsSince(start);
+        start = std::chrono::steady_clock::now();
+        for (const Phase1Coordinates &c : phase1[k]) flipSliceSum += flipSliceDistance(c);
+        double flipSliceRate = count / secondsSince(start);
+        std::cout << "  " << names[k] << ": pairwise " << pairwiseRate / 1e6 << " M lookups/s, mean distance "
+                  << (double) pairwiseSum / count << "; flip-slice " << flipSliceRate / 1e6
+                  << " M lookups/s, mean distance " << (double) flipSliceSum / count << std::endl;
+    }
+    std::cout << "  distances differing or pairwise above exact " << mismatches << std::endl;
+    return mismatches ? 1 : 0;
+}
+
+/*
+ * The solution cache: `count` scrambles inserted with their undoing as solution, then each looked up seen through a
+ * random symmetry and maybe inverted, which must hit and give moves solving the cube asked for; with a capacity
+ * under `count` the oldest are evicted and miss. The cache is then written to `file`, read back into an empty one and
+ * looked up again.
+ */
+static int benchCache(int argc, char **argv) {
+    long count = argc > 0 ? std::atol(argv[0]) : 100000L;
+    size_t capacity = argc > 1 ? (size_t) std::atol(argv[1]) : (size_t) count;
+    std::string path = argc > 2 ? argv[2] : "solutions.cache";
+
+    std::mt19937 rng(17);
+    std::vector<CubeState> cubes(count), queries(count);
+    std::vector<std::vector<int>> solutions(count);
+    for (long i = 0; i < count; i++) {
+        std::vector<int> scramble(20);
+        for (int &m : scramble) m = (int) (rng() % MOVE_COUNT);
+        cubes[i] = CubeState::solved().moves(scramble);
+        solutions[i] = inverseMoves(scramble);
+        CubeState seen = rng() % 2 ? cubes[i].inverse() : cubes[i];
+        queries[i] = conjugate(seen, (int) (rng() % SYMMETRY_COUNT));
+    }
+
+    SolutionCache cache(capacity);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++) cache.insert(cubes[i], solutions[i]);
+    double insertRate = count / secondsSince(start);
+
+    long wrong = 0;
+    std::vector<int> moves;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++)
+        if (cache.find(queries[i], moves) && !queries[i].moves(moves).isSolved()) wrong++;
+    double findRate = count / secondsSince(start);
+    SolutionCache::Stats stats = cache.stats();
+    std::cout << "cache: " << count << " cubes, capacity " << capacity << ": " << insertRate / 1e6
+              << " M inserts/s, " << findRate / 1e6 << " M lookups/s" << std::endl;
+    std::cout << "  " << stats.entries << " entries, " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.evictions << " evictions, " << wrong << " wrong" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    if (!cache.save(path)) return 1;
+    double saveSeconds = secondsSince(start);
+    SolutionCache loaded(capacity);
+    const char *problem = NULL;
+    start = std::chrono::steady_clock::now();
+    if (!loaded.load(path, &problem)) {
+        std::cerr << "ERROR! " << path << ": " << problem << "\n";
+        return 1;
+    }
+    double loadSeconds = secondsSince(start);
+    long reloadedHits = 0;
+    for (long i = 0; i < count; i++) {
+        if (!loaded.find(queries[i], moves)) continue;
+        reloadedHits++;
+        if (!queries[i].moves(moves).isSolved()) wrong++;
+    }
+    std::cout << "  written to " << path << " in " << saveSeconds << " s, read back in " << loadSeconds << " s: "
+              << loaded.stats().entries << " entries, " << reloadedHits << " hits, " << wrong << " wrong" << std::endl;
+    return wrong || reloadedHits != stats.hits ? 1 : 0;
+}
+
+/*
+ * The endgame table of the depth that fits in `budgetMB`: build time and size, then scrambles of up to that many
+ * moves solved by lookup and by the two-phase solver (tables from `tableFile`). Lookup solutions must solve the cube
+ * and be no longer than two-phase ones, which for such short scrambles are optimal too.
+ */
+static int benchEndgame(int argc, char **argv) {
+    size_t budget = (size_t) (argc > 0 ? std::atol(argv[0]) : 16) << 20;
+    long count = argc > 1 ? std::atol(argv[1]) : 10000L;
+    int depth = EndgameTable::depthFor(budget);
+    if (depth == 0) {
+        std::cerr << "ERROR! Not even a depth 1 table fits in " << (budget >> 20) << " MB\n";
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EndgameTable endgame;
+    endgame.build(depth);
+    double buildSeconds = secondsSince(start);
+
+    static TwoPhaseTables tables;
+    tables.loadOrBuild(argc > 2 ? argv[2] : "", TableLoadOptions());
+    TwoPhaseSolver solver(tables);
+
+    std::mt19937 rng(23);
+    std::vector<CubeState> cubes(count);
+    for (CubeState &c : cubes) {
+        c = CubeState::solved();
+        for (int k = (int) (rng() % (depth + 1)); k > 0; k--) c = c.move((int) (rng() % MOVE_COUNT));
+    }
+
+    long wrong = 0, longer = 0, lookupMoves = 0, searchMoves = 0;
+    std::vector<std::vector<int>> lookups(count);
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++)
+        if (!endgame.solve(cubes[i], lookups[i])) wrong++;
+    double lookupRate = count / secondsSince(start);
+
+    SolveOptions options;
+    options.maxLength = 0;      // the shortest two-phase solution within the timeout
+    options.timeoutMs = 50.0;
+    std::vector<Solution> searched(count);
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++) solver.solve(cubes[i], options, searched[i]);
+    double searchRate = count / secondsSince(start);
+
+    for (long i = 0; i < count; i++) {
+        if (!cubes[i].moves(lookups[i]).isSolved()) wrong++;
+        if (searched[i].found && lookups[i].size() > searched[i].moves.size()) longer++;
+        lookupMoves += (long) lookups[i].size();
+        searchMoves += (long) searched[i].moves.size();
+    }
+    std::cout << "endgame: depth " << depth << ", " << EndgameTable::CUBES_WITHIN[depth] << " cubes in "
+              << endgame.bytes() / 1e6 << " MB (" << 100.0 * EndgameTable::CUBES_WITHIN[depth] / (endgame.bytes() / 16)
+              << "% full), built in " << buildSeconds << " s" << std::endl;
+    std::cout << "  " << count << " scrambles of up to " << depth << " moves: lookup " << lookupRate / 1e3
+              << " k solves/s, mean " << (double) lookupMoves / count << " moves; two-phase " << searchRate / 1e3
+              << " k solves/s, mean " << (double) searchMoves / count << " moves" << std::endl;
+    std::cout << "  wrong " << wrong << ", longer than two-phase " << longer << std::endl;
+    return wrong || longer ? 1 : 0;
+}
+
+/*
+ * Reference rankings, as they were written first: a digit is found by comparing with every other value, a value by
+ * scanning the unused ones, an orientation slot by slot.
+ */
+static int naivePermutationRank(const int *p, int n, int k) {
+    int rank = 0;
+    for (int i = 0; i < k; i++) {
+        int below = 0;
+        for (int j = 0; j < i; j++)
+            if (p[j] < p[i]) below++;
+        rank = rank * (n - i) + p[i] - below;
+    }
+    return rank;
+}
+
+static void naivePermutationUnrank(int rank, int *p, int n, int k) {
+    int digits[12];
+    for (int i = k - 1; i >= 0; i--) {
+        digits[i] = rank % (n - i);
+        rank /= n - i;
+    }
+    bool used[12] = {};
+    for (int i = 0; i < k; i++) {
+        int d = digits[i];
+        for (int v = 0; v < n; v++) {
+            if (used[v]) continue;
+            if (d-- == 0) {
+                p[i] = v;
+                used[v] = true;
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Coordinates per second of a reference and a fast ranking over the same inputs; 1 if their results differ.
+ */
+template <class Naive, class Fast>
+static int compareCoordinates(const char *name, const char *path, const std::vector<CubeState> &cubes,
+                              const std::vector<int> &ranks, Naive naive, Fast fast) {
+    long sum[2] = {0, 0};
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < cubes.size(); i++) sum[0] += naive(cubes[i], ranks[i]);
+    double naiveRate = cubes.size() / secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < cubes.size(); i++) sum[1] += fast(cubes[i], ranks[i]);
+    double fastRate = cubes.size() / secondsSince(start);
+    std::cout << "  " << name << ": naive " << naiveRate / 1e6 << " M/s, " << path << " " << fastRate / 1e6
+              << " M/s (" << fastRate / naiveRate << "x)" << std::endl;
+    return sum[0] != sum[1];
+}
+
+/*
+ * Rankings of the permutations Coordinates.cpp uses, portable or BMI2, bound to one implementation so that the
+ * benchmark can time each whatever the CPU picks.
+ */
+struct RankingImplementation {
+    const char *name;
+    int (*rank)(const int *p, int n, int k);
+    void (*unrank)(int rank, int *p, int n, int k);
+};
+
+/*
+ * Coordinates per second of every ranking this CPU can run against the reference ones, on `count` random cubes:
+ * corner permutation rank and unrank (8 values) and the Korf edge positions (7 of 12). All ranks of both
+ * permutations are first checked to agree, and every twist and flip to read back as set.
+ */
+static int benchCoordinates(int argc, char **argv) {
+    long count = argc > 0 ? std::atol(argv[0]) : 4000000L;
+    std::vector<RankingImplementation> implementations = {
+            {"portable", partialPermutationRankPortable, partialPermutationUnrankPortable}};
+#ifdef COORDINATES_X86
+    if (cpuHasBmi2()) implementations.push_back({"bmi2", partialPermutationRankBmi2, partialPermutationUnrankBmi2});
+#endif
+
+    long mismatches = 0;
+    int p[12], q[12];
+    for (const RankingImplementation &impl : implementations) {
+        for (int r = 0; r < CORNER_PERM_COUNT; r++) {
+            impl.unrank(r, p, 8, 8);
+            naivePermutationUnrank(r, q, 8, 8);
+            if (!std::equal(p, p + 8, q) || impl.rank(p, 8, 8) != r || naivePermutationRank(p, 8, 8) != r)
+                mismatches++;
+        }
+        for (int r = 0; r < 12 * 11 * 10 * 9 * 8 * 7 * 6; r++) {
+            impl.unrank(r, p, 12, 7);
+            naivePermutationUnrank(r, q, 12, 7);
+            if (!std::equal(p, p + 7, q) || impl.rank(p, 12, 7) != r) mismatches++;
+        }
+    }
+    CubeState c = CubeState::solved();
+    for (int t = 0; t < TWIST_COUNT; t++) {
+        setTwist(c, t);
+        if (twistOf(c) != t || c.verify() != NULL) mismatches++;
+    }
+    for (int f = 0; f < FLIP_COUNT; f++) {
+        setFlip(c, f);
+        if (flipOf(c) != f || c.verify() != NULL) mismatches++;
+    }
+
+    std::mt19937 rng(29);
+    std::vector<CubeState> cubes(count);
+    std::vector<int> ranks(count);
+    for (long i = 0; i < count; i++) {
+        cubes[i] = CubeState::random(rng);
+        ranks[i] = (int) (rng() % CORNER_PERM_COUNT);
+    }
+
+    std::cout << "coordinates: " << count << " random cubes, " << mismatches << " mismatches, rankings use "
+              << (rankingBmi2 ? "bmi2" : "portable") << std::endl;
+    auto naiveCornerRank = [](const CubeState &s, int) {
+        int v[8];
+        for (int i = 0; i < 8; i++) v[i] = s.corner(i);
+        return naivePermutationRank(v, 8, 8);
+    };
+    auto naiveCornerUnrank = [](const CubeState &, int r) {
+        int v[8];
+        naivePermutationUnrank(r, v, 8, 8);
+        return v[0] * 8 + v[7];
+    };
+    auto naiveEdgeRank = [](const CubeState &s, int) {
+        int v[7];
+        for (int e = 0; e < 7; e++) v[e] = s.edge(e);
+        return naivePermutationRank(v, EDGE_COUNT, 7);
+    };
+    mismatches += compareCoordinates("corner permutation rank", "portable", cubes, ranks, naiveCornerRank,
+                                     [](const CubeState &s, int) {
+        int v[8];
+        for (int i = 0; i < 8; i++) v[i] = s.corner(i);
+        return partialPermutationRankPortable(v, 8, 8);
+    });
+    mismatches += compareCoordinates("corner permutation unrank", "portable", cubes, ranks, naiveCornerUnrank,
+                                     [](const CubeState &, int r) {
+        int v[8];
+        partialPermutationUnrankPortable(r, v, 8, 8);
+        return v[0] * 8 + v[7];
+    });
+    mismatches += compareCoordinates("edge positions rank (7 of 12)", "portable", cubes, ranks, naiveEdgeRank,
+                                     [](const CubeState &s, int) {
+        int v[7];
+        for (int e = 0; e < 7; e++) v[e] = s.edge(e);
+        return partialPermutationRankPortable(v, EDGE_COUNT, 7);
+    });
+#ifdef COORDINATES_X86
+    if (implementations.size() > 1) {
+        mismatches += compareCoordinates("corner permutation rank", "bmi2", cubes, ranks, naiveCornerRank,
+                                         [](const CubeState &s, int) {
+            int v[8];
+            for (int i = 0; i < 8; i++) v[i] = s.corner(i);
+            return partialPermutationRankBmi2(v, 8, 8);
+        });
+        mismatches += compareCoordinates("corner permutation unrank", "bmi2", cubes, ranks, naiveCornerUnrank,
+                                         [](const CubeState &, int r) {
+            int v[8];
+            partialPermutationUnrankBmi2(r, v, 8, 8);
+            return v[0] * 8 + v[7];
+        });
+        mismatches += compareCoordinates("edge positions rank (7 of 12)", "bmi2", cubes, ranks, naiveEdgeRank,
+                                         [](const CubeState &s, int) {
+            int v[7];
+            for (int e = 0; e < 7; e++) v[e] = s.edge(e);
+            return partialPermutationRankBmi2(v, EDGE_COUNT, 7);
+        });
+    }
+#endif
+    return mismatches ? 1 : 0;
+}
+
+/*
+ * The optimal solver with full and with modulo 3 pattern databases, built in memory: size of the databases, then
+ * solve time and nodes per second on the same scrambles. Both must find solutions of the same lengths.
+ */
+static int benchModulo(int argc, char **argv) {
+    int count = argc > 0 ? std::atoi(argv[0]) : 20;
+    int scrambleLength = argc > 1 ? std::atoi(argv[1]) : 12;
+    int pieces = argc > 2 ? std::atoi(argv[2]) : KorfTables::MIN_EDGE_PIECES;
+
+    std::mt19937 rng(3);
+    std::vector<CubeState> cubes;
+    for (int i = 0; i < count; i++) {
+        std::vector<int> scramble;
+        for (int k = 0; k < scrambleLength; k++) {
+            int m;
+            do m = (int) (rng() % MOVE_COUNT);
+            while (!scramble.empty() && moveFace(m) == moveFace(scramble.back()));
+            scramble.push_back(m);
+        }
+        cubes.push_back(CubeState::solved().moves(scramble));
+    }
+
+    std::vector<size_t> lengths[2];
+    int wrong = 0;
+    for (int modulo = 0; modulo < 2; modulo++) {
+        KorfTables tables;
+        tables.build(pieces, modulo == 1);
+        KorfSolver solver(tables);
+        SolveOptions options;
+        options.maxLength = scrambleLength;
+        options.timeoutMs = 1e9;
+        double totalMs = 0.0;
+        long nodes = 0;
+        for (const CubeState &cube : cubes) {
+            Solution solution;
+            if (!solver.solve(cube, options, solution) || !verifySolution(cube.toFacelets(), solution.moves)) wrong++;
+            totalMs += solution.solveMs;
+            nodes += solution.nodes;
+            lengths[modulo].push_back(solution.moves.size());
+        }
+        std::cout << (modulo ? "modulo 3 (2 bits): " : "full (4 bits):     ") << tables.bytes() / 1e6 << " MB, mean "
+                  << totalMs / count << " ms, " << nodes / std::max(totalMs, 1e-9) / 1e3 << " M nodes/s, " << nodes
+                  << " nodes" << std::endl;
+    }
+    if (lengths[0] != lengths[1]) wrong++;
+    std::cout << "  not found, wrong or of another length " << wrong << std::endl;
+    return wrong ? 1 : 0;
+}
+
+struct Benchmark {
+    const char *name;
+    const char *usage;
+    int (*run)(int argc, char **argv);
+};
+
+static const Benchmark benchmarks[] = {
+        {"moves", "moves [count]", benchMoves},
+        {"facelets", "facelets [count]", benchFacelets},
+        {"tables", "tables [file] [threads] [progress]", benchTables},
+        {"twophase", "twophase [count] [maxLength] [timeoutMs] [tableFile] [orientations]", benchTwoPhase},
+        {"korf", "korf [count] [scrambleLength] [edgePieces] [tableFile] [threads] [hugepages]", benchKorf},
+        {"modulo", "modulo [count] [scrambleLength] [edgePieces]", benchModulo},
+        {"symmetry", "symmetry [count]", benchSymmetry},
+        {"cache", "cache [count] [capacity] [file]", benchCache},
+        {"endgame", "endgame [budgetMB] [count] [tableFile]", benchEndgame},
+        {"coordinates", "coordinates [count]", benchCoordinates},
+};
+
+int main(int argc, char **argv) {
+    if (argc >= 2) {
+        for (const Benchmark &b : benchmarks)
+            if (std::strcmp(argv[1], b.name) == 0) return b.run(argc - 2, argv + 2);
+    }
+    std::cerr << "usage:" << std::endl;
+    for (const Benchmark &b : benchmarks) std::cerr << "  " << argv[0] << " " << b.usage << std::endl;
+    return 1;
+}
@@ -6,10 +6,30 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/videoio.hpp>
 
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <UTIL/UtilGLSL.cpp>
+#include <VISION/QualityGovernor.cpp>
+#include <VISION/FrameSource.cpp>
+#include <VISION/LatencyHarness.cpp>
+#include <VISION/FrameRecorder.cpp>
+#include <VISION/Undistortion.cpp>
+#include <VISION/CubeTracker.cpp>
+#include <VISION/StickerSampler.cpp>
+#include <VISION/FaceAccumulator.cpp>
+#include <VISION/ColorAssignment.cpp>
+#include <CUBE/FaceletCube.cpp>
+#include <SOLVER/TwoPhaseSolver.cpp>
+#include <SOLVER/SolverService.cpp>
+#include <SOLVER/SolutionCache.cpp>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
@@ -23,6 +43,55 @@ using namespace cv;
 // index of our texture / camera feed
 GLuint textureID;
 
+// capture time of the frame currently in the texture
+FrameStamp textureStamp;
+
+// index of the undistortion map sampled by the background shader
+GLuint undistortMapID;
+
+// lens undistortion, NULL without intrinsics
+Undistorter *undistorter = NULL;
+bool undistortOnCpu = false;
+
+// part of the frame the detector looks at, empty for the whole frame
+cv::Rect detectorRoi;
+
+// cube face detection and pose tracking
+GridDetector gridDetector;
+CubeTracker cubeTracker;
+
+// sticker colors of the faces seen in the last detection
+StickerSampler stickerSampler;
+std::vector<FaceSample> faceSamples;
+
+// colors voted over recent frames
+FaceAccumulator faceAccumulator;
+
+// colors of the 54 stickers, solved as a whole once every face is committed
+ColorAssigner colorAssigner;
+ColorAssignment scannedCube;
+CubeState scannedState;
+TwoPhaseTables twoPhaseTables;
+std::atomic<bool> solverReady(false);  // set by the thread loading the tables
+bool solvePending = false;              // a scanned cube waits for the solver
+SolveOptions solveOptions;              // budget and target length of a solve
+EndgameTable endgameTable;              // cubes a few moves from solved, answered without a search
+
+// solve of the latest scanned cube: its final result, and the shortest solution so far, published by the solver
+// thread each time it finds a shorter one
+std::future<Solution> solveResult;
+CubeState solveCube;                    // the cube solveResult solves
+CancellationToken solveToken;
+long solveId = 0;                       // of the latest request, older ones no longer publish
+std::mutex bestSolutionLock;
+Solution bestSolution;
+long bestSolutionVersion = 0;           // bumped on every publication
+long shownSolutionVersion = 0;          // last version the render loop showed
+
+// solutions of cubes scanned before, in any orientation, kept in cachePath between runs
+SolutionCache solutionCache;
+std::string cachePath;
+
 // index of our shaders
 GLuint shaderProgram;
 
@@ -43,6 +112,13 @@ void initTexture() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+    glGenTextures(1, &undistortMapID);
+    glBindTexture(GL_TEXTURE_2D, undistortMapID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
 /*
@@ -89,27 +165,276 @@ void initBackground() {
     glBindVertexArray(0);
 }
 
-void imageProcessing(VideoCapture *cap) {
-    Mat toTexture;
+/*
+ * Camera matrix and distortion of the frames the detector sees, at the given capture size.
+ */
+void cameraModel(cv::Size size, Mat &K, Mat &dist) {
+    if (undistorter && undistortOnCpu) {
+        // the detector region has been undistorted already
+        undistorter->prepare(size);
+        K = undistorter->cameraMatrix();
+        dist = Mat::zeros(1, 5, CV_64F);
+    } else if (undistorter) {
+        K = undistorter->cameraIntrinsics().cameraMatrixFor(size);
+        dist = undistorter->cameraIntrinsics().distCoeffs;
+    } else {
+        // uncalibrated: a typical webcam field of view and no distortion
+        K = (cv::Mat_<double>(3, 3) << 0.9 * size.width, 0, 0.5 * size.width,
+                                       0, 0.9 * size.width, 0.5 * size.height,
+                                       0, 0, 1);
+        dist = Mat::zeros(1, 5, CV_64F);
+    }
+}
+
+/*
+ * Print the faces committed so far, U R F D L B, '.' for faces not read yet.
+ */
+void printScan() {
+    std::cout << "[scan] ";
+    for (int face = 0; face < POSE_FACE_COUNT; face++) {
+        for (int s = 0; s < 9; s++) {
+            std::cout << (faceAccumulator.committed(face) ? stickerColorNames[faceAccumulator.color(face, s)] : '.');
+        }
+        std::cout << (face + 1 < POSE_FACE_COUNT ? " " : "\n");
+    }
+}
+
+/*
+ * Hand the scanned cube to the solver service. The first solution comes within milliseconds and is published to
+ * bestSolution, then every shorter one until the target length or the deadline of solveOptions. A solve of an
+ * earlier scan still running is cancelled, one still queued is replaced. A cube solved before is not solved again:
+ * its cached solution is the result.
+ */
+void startSolving(SolverService<TwoPhaseSolver> &service) {
+    solveToken.cancel();
+    solveToken = CancellationToken();
+    long id;
+    {
+        std::lock_guard<std::mutex> lock(bestSolutionLock);
+        id = ++solveId;
+    }
+    solveCube = scannedState;
+
+    Solution cached;
+    if (solutionCache.find(solveCube, cached.moves)) {
+        cached.found = true;
+        std::promise<Solution> result;
+        result.set_value(cached);
+        solveResult = result.get_future();
+        std::cout << "[solver] solved before" << std::endl;
+        return;
+    }
+    SolveOptions options = solveOptions;
+    options.cancel = solveToken;
+    options.improved = [id](const Solution &s) {
+        std::lock_guard<std::mutex> lock(bestSolutionLock);
+        if (id != solveId) return;
+        bestSolution = s;
+        bestSolutionVersion++;
+    };
+    solveResult = service.submit(solveCube, options);
+}
+
+/*
+ * Show the best solution so far in the window title and the log when it changed. Never waits for the solver: the
+ * final result is only taken once ready, and if an improvement is being published right now it is shown on the next
+ * frame.
+ */
+void showBestSolution(GLFWwindow *window) {
+    Solution solution;
+    bool done = solveResult.valid() && solveResult.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    if (done) {
+        solution = solveResult.get();
+        if (solution.found) solutionCache.insert(solveCube, solution.moves);
+        // the improvements not shown yet are all longer; the solve has returned, so nothing holds the lock for long
+        std::lock_guard<std::mutex> lock(bestSolutionLock);
+        shownSolutionVersion = bestSolutionVersion;
+        if (!solution.found) {
+            if (!solution.cancelled) std::cerr << "ERROR! No solution found for " << scannedCube.facelets << std::endl;
+            return;
+        }
+    } else {
+        std::unique_lock<std::mutex> lock(bestSolutionLock, std::try_to_lock);
+        if (!lock.owns_lock() || bestSolutionVersion == shownSolutionVersion) return;
+        shownSolutionVersion = bestSolutionVersion;
+        solution = bestSolution;
+    }
+
+    std::string moves = formatMoves(solution.moves);
+    std::cout << "[solver] " << (done ? "" : "so far ") << moves << " (" << solution.moves.size() << " moves, "
+              << solution.solveMs << " ms)" << std::endl;
+    std::string title = "rubikscube - " + std::to_string(solution.moves.size()) + " moves" + (done ? "" : "...")
+                        + ": " + moves;
+    glfwSetWindowTitle(window, title.c_str());
+}
+
+/*
+ * Assign all 54 stickers from the committed faces at once, with exactly nine per color and real cubies only.
+ */
+void assignColors() {
+    float lab[FACELET_COUNT][3];
+    for (int face = 0; face < FACE_COUNT; face++) {
+        for (int s = 0; s < 9; s++) {
+            cv::Vec3f mean = faceAccumulator.meanLab(face, s);
+            for (int k = 0; k < 3; k++) lab[facelet(face, s + 1)][k] = mean[k];
+        }
+    }
+    colorAssigner.assign(lab, scannedCube);
+    std::cout << "[scan] cube " << scannedCube.facelets << " (" << scannedCube.solveMs << " ms)";
+    if (!scannedCube.solvable) {
+        std::cout << " not solvable: " << scannedCube.problem << ", rescan";
+    } else {
+        // the stickers must read back from the cubie model exactly as the camera saw them
+        const char *problem = CubeState::fromFacelets(scannedCube.facelets, scannedState);
+        if (problem != NULL || !faceletsMatch(scannedCube.facelets, scannedState)) {
+            std::cout << " does not match the cubie model: " << (problem ? problem : "stickers differ") << ", rescan";
+            scannedCube.solvable = false;
+        }
+    }
+    std::cout << std::endl;
+    solvePending = scannedCube.solvable;
+}
+
+/*
+ * Find a face, in the region around the tracked cube if there is one, update the cube pose and sample the visible
+ * faces. workframe is captureframe scaled by `scale`; results are in capture coordinates. The pose solve time of a
+ * tracked cube goes to `latency`, if given.
+ */
+void detectCube(const Mat &captureframe, const Mat &workframe, double scale, double captureMs,
+                LatencyHarness *latency) {
+    cv::Size captureSize = captureframe.size();
+    Mat K, dist;
+    cameraModel(captureSize, K, dist);
+
+    cv::Rect frameRect(0, 0, captureSize.width, captureSize.height);
+    cv::Rect roi = cubeTracker.tracking() ? cubeTracker.bounds(K, dist, 0.25) & frameRect : frameRect;
+    if (roi.area() < 64 * 64) {
+        roi = frameRect;
+    }
+    cv::Rect scaledRoi = cv::Rect((int) (roi.x * scale), (int) (roi.y * scale), (int) (roi.width * scale),
+                                  (int) (roi.height * scale)) & cv::Rect(0, 0, workframe.cols, workframe.rows);
+
+    FaceGrid grid;
+    bool found = gridDetector.detect(workframe(scaledRoi), grid);
+    if (!found) {
+        cubeTracker.missed();
+    } else {
+        cv::Point2f offset((float) scaledRoi.x, (float) scaledRoi.y);
+        for (int k = 0; k < 4; k++) grid.corners[k] = (grid.corners[k] + offset) * (1.0 / scale);
+        for (int k = 0; k < 9; k++) grid.centers[k] = (grid.centers[k] + offset) * (1.0 / scale);
+        found = cubeTracker.update(grid, K, dist, captureMs);
+        if (latency && cubeTracker.poseSolveTracked()) {
+            latency->trackedPoseSolved(cubeTracker.poseSolveMs());
+        }
+    }
+
+    // read every face turned towards the camera
+    faceSamples.clear();
+    if (found) {
+        stickerSampler.sampleVisibleFaces(captureframe, cubeTracker.pose(), cubeTracker.cubeSize(), K, dist,
+                                          faceSamples);
+        if (faceAccumulator.addFrame(faceSamples, cubeTracker.poseConsistent()) > 0) {
+            printScan();
+            if (faceAccumulator.allCommitted()) {
+                assignColors();
+            }
+        }
+    }
+
+    detectorRoi = cubeTracker.tracking() ? cubeTracker.bounds(K, dist, 0.25) & frameRect : cv::Rect();
+}
+
+/*
+ * Draw the edges of the tracked cube on an image scaled by `scale`.
+ */
+void drawCube(Mat &image, double scale, cv::Size captureSize) {
+    if (!cubeTracker.tracking()) return;
+    Mat K, dist;
+    cameraModel(captureSize, K, dist);
+
+    std::vector<cv::Point3f> corners;
+    double h = 0.5 * cubeTracker.cubeSize();
+    for (int i = 0; i < 8; i++)
+        corners.push_back(cv::Point3f((float) (i & 1 ? h : -h), (float) (i & 2 ? h : -h), (float) (i & 4 ? h : -h)));
+    std::vector<cv::Point2f> projected;
+    cubeTracker.project(corners, K, dist, projected);
+
+    for (int a = 0; a < 8; a++) {
+        for (int bit = 1; bit < 8; bit <<= 1) {
+            int b = a | bit;
+            if (b == a) continue;
+            cv::line(image, projected[a] * scale, projected[b] * scale, cv::Scalar(0, 255, 0), 2);
+        }
+    }
+
+    // the color read for every sampled sticker
+    std::vector<cv::Point3f> centers;
+    for (size_t i = 0; i < faceSamples.size(); i++) {
+        StickerSampler::stickerCenters(faceSamples[i].face, cubeTracker.cubeSize(), centers);
+        cubeTracker.project(centers, K, dist, projected);
+        for (int k = 0; k < 9; k++) {
+            cv::circle(image, projected[k] * scale, 4, stickerColorBgr[faceSamples[i].colors[k]], cv::FILLED);
+        }
+    }
+}
+
+void imageProcessing(FrameSource *source, QualityGovernor *governor, LatencyHarness *latency) {
+    QualityLevel level = governor->level();
 
     // Read camera
-    Mat currentframe;
-    cap->read(currentframe);
+    Frame frame;
+    bool captured = source->read(frame);
+    governor->stageDone(STAGE_CAPTURE);
+    if (!captured || frame.image.empty()) {
+        return;
+    }
+    if (latency) {
+        latency->captured(frame);
+    }
+    Mat currentframe = frame.image;
+
+    // Lens undistortion, on the CPU only where the detector looks, otherwise in the background shader
+    if (undistorter && undistortOnCpu) {
+        cv::Rect roi = detectorRoi.empty() ? cv::Rect(0, 0, currentframe.cols, currentframe.rows) : detectorRoi;
+        roi = roi & cv::Rect(0, 0, currentframe.cols, currentframe.rows);
+        Mat undistorted;
+        undistorter->applyRoi(currentframe, undistorted, roi);
+        if (!undistorted.empty()) {
+            undistorted.copyTo(currentframe(roi));
+        }
+    } else if (undistorter) {
+        undistorter->prepare(currentframe.size());
+    }
 
     // Image Processing
-    Mat blurredframe;
-    cv::GaussianBlur(currentframe, blurredframe, cv::Size(0,0), 1.6, 0);
+    Mat workframe = currentframe;
+    if (level.processScale < 1.0) {
+        cv::resize(currentframe, workframe, cv::Size(), level.processScale, level.processScale, cv::INTER_AREA);
+    }
+    Mat blurredframe, toTexture;
+    cv::GaussianBlur(workframe, blurredframe, cv::Size(0,0), 1.6 * level.processScale, 0);
+    cv::absdiff(blurredframe, workframe, toTexture);
+    governor->stageDone(STAGE_PROCESS);
+
+    // Cube detection and pose tracking, skipped frames show the last tracked pose
+    if (governor->shouldDetect()) {
+        detectCube(currentframe, workframe, level.processScale, frame.captureMs, latency);
+    }
+    governor->stageDone(STAGE_DETECT);
 
     // Convert Mat from opencv to OpenGl's Texture2D
-    cv::absdiff(blurredframe, currentframe, toTexture);
-
-    // EDGE DETECTOR ?
-
+    drawCube(toTexture, level.processScale, currentframe.size());
     cv::flip(toTexture, toTexture, 0);
-
     glBindTexture(GL_TEXTURE_2D, textureID);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, toTexture.cols, toTexture.rows, 0, GL_BGR, GL_UNSIGNED_BYTE, toTexture.ptr());
     glGenerateMipmap(GL_TEXTURE_2D);
+    governor->stageDone(STAGE_UPLOAD);
+
+    textureStamp.index = frame.index;
+    textureStamp.captureMs = frame.captureMs;
+    textureStamp.driverTimestamp = frame.driverTimestamp;
+    textureStamp.frameSize = currentframe.size();
+    textureStamp.processedMs = nowMs();
 }
 
 /*
@@ -121,18 +446,156 @@ void render() {
     glClear(GL_COLOR_BUFFER_BIT);
 
     // Texture
+    glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, textureID);
 
     // Shader
     glUseProgram(shaderProgram);
 
+    // Undistortion map
+    bool undistortInShader = undistorter && !undistortOnCpu;
+    glUniform1i(glGetUniformLocation(shaderProgram, "ourTexture"), 0);
+    glUniform1i(glGetUniformLocation(shaderProgram, "undistortMap"), 1);
+    glUniform1i(glGetUniformLocation(shaderProgram, "undistort"), undistortInShader);
+    if (undistortInShader) {
+        glActiveTexture(GL_TEXTURE1);
+        undistorter->uploadShaderMap(undistortMapID);
+        glBindTexture(GL_TEXTURE_2D, undistortMapID);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
     // Draw triangles
     glBindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    // frame-time budget the quality governor keeps the loop within
+    double targetFrameMs = 1000.0 / 30.0;
+    bool measureLatency = false;    // report capture-to-present latencies
+    bool synthetic = false;         // generated frames instead of the camera
+    bool headless = false;          // hidden window
+    long maxFrames = -1;            // stop after that many frames, -1 = run until closed
+    std::string recordPath;         // record captured frames to this file
+    std::string replayPath;         // replay frames from this recording instead of the camera
+    bool replayRealtime = true;     // replay at the recorded pace
+    std::string intrinsicsPath;     // camera intrinsics, enables undistortion
+    std::string calibratePath;      // compute intrinsics from this checkerboard recording and exit
+    cv::Size boardSize(9, 6);       // inner corners of the calibration checkerboard
+    double squareSize = 1.0;        // side of a checkerboard square
+    std::string tablesPath = "twophase.tables";   // solver tables, built and written there when missing
+    size_t endgameBudget = (size_t) 16 << 20;     // memory for the endgame table, 0 for none
+    std::string endgameTablesPath = "endgame.tables";
+    TableLoadOptions tableOptions;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--target-ms" && i + 1 < argc) {
+            targetFrameMs = std::atof(argv[++i]);
+        } else if (arg == "--latency") {
+            measureLatency = true;
+        } else if (arg == "--synthetic") {
+            synthetic = true;
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            maxFrames = std::atol(argv[++i]);
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (arg == "--replay-fast") {
+            replayRealtime = false;
+        } else if (arg == "--intrinsics" && i + 1 < argc) {
+            intrinsicsPath = argv[++i];
+        } else if (arg == "--undistort" && i + 1 < argc) {
+            undistortOnCpu = std::string(argv[++i]) == "cpu";
+        } else if (arg == "--calibrate" && i + 1 < argc) {
+            calibratePath = argv[++i];
+        } else if (arg == "--board" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &boardSize.width, &boardSize.height) != 2) {
+                std::cerr << "--board expects <columns>x<rows>\n";
+                return -1;
+            }
+        } else if (arg == "--square" && i + 1 < argc) {
+            squareSize = std::atof(argv[++i]);
+        } else if (arg == "--tables" && i + 1 < argc) {
+            tablesPath = argv[++i];
+        } else if (arg == "--tables-lazy") {
+            tableOptions.prefault = false;
+            tableOptions.verify = false;
+        } else if (arg == "--solve-ms" && i + 1 < argc) {
+            solveOptions.timeoutMs = std::atof(argv[++i]);
+        } else if (arg == "--solve-length" && i + 1 < argc) {
+            solveOptions.maxLength = std::atoi(argv[++i]);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cachePath = argv[++i];
+        } else if (arg == "--endgame-mb" && i + 1 < argc) {
+            endgameBudget = (size_t) std::atol(argv[++i]) << 20;
+        } else if (arg == "--endgame-tables" && i + 1 < argc) {
+            endgameTablesPath = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            std::cerr << "Usage: rubikscube [--target-ms <frame time budget>] [--latency] [--synthetic] "
+                         "[--headless] [--frames <count>] [--record <file>] [--replay <file>] [--replay-fast] "
+                         "[--intrinsics <file>] [--undistort <cpu|gpu>] "
+                         "[--tables <file>] [--tables-lazy] [--solve-ms <ms>] [--solve-length <moves>] "
+                         "[--cache <file>] [--endgame-mb <MB>] [--endgame-tables <file>] "
+                         "[--calibrate <recording> [--board <columns>x<rows>] [--square <size>] --intrinsics <file>]\n";
+            return -1;
+        }
+    }
+
+    // calibration command: checkerboard recording in, intrinsics out
+    if (!calibratePath.empty()) {
+        if (intrinsicsPath.empty()) {
+            std::cerr << "--calibrate needs --intrinsics <file> to write the result to\n";
+            return -1;
+        }
+        CameraIntrinsics intrinsics;
+        if (!calibrateFromRecording(calibratePath, boardSize, squareSize, intrinsics)
+            || !intrinsics.save(intrinsicsPath)) {
+            return -1;
+        }
+        std::cout << "Intrinsics written to " << intrinsicsPath << std::endl;
+        return 0;
+    }
+
+    CameraIntrinsics intrinsics;
+    if (!intrinsicsPath.empty()) {
+        if (!intrinsics.load(intrinsicsPath)) {
+            return -1;
+        }
+        undistorter = new Undistorter(intrinsics);
+    }
+    // without a display the latency harness is the only output
+    if (headless) {
+        measureLatency = true;
+    }
+
+    // solver tables: mapped from their file, or built the first time, while the window opens and the camera starts
+    std::thread solverLoader([tablesPath, tableOptions, endgameBudget, endgameTablesPath]() {
+        twoPhaseTables.loadOrBuild(tablesPath, tableOptions);
+        int endgameDepth = EndgameTable::depthFor(endgameBudget);
+        if (endgameDepth > 0) {
+            endgameTable.loadOrBuild(endgameTablesPath, endgameDepth, tableOptions);
+            solveOptions.endgame = &endgameTable;
+        }
+        const char *problem = NULL;
+        if (!cachePath.empty() && solutionCache.load(cachePath, &problem)) {
+            std::cout << "[solver] " << solutionCache.stats().entries << " cached solutions read from " << cachePath
+                      << std::endl;
+        }
+        solverReady = true;
+    });
+    // joined on every way out of main
+    struct JoinOnExit {
+        std::thread &thread;
+        ~JoinOnExit() { if (thread.joinable()) thread.join(); }
+    } joinSolverLoader{solverLoader};
+    // solves off the render thread, requests are only submitted once the tables are ready
+    SolverService<TwoPhaseSolver> solverService(twoPhaseTables);
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -144,6 +607,10 @@ int main()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+    if (headless) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+
     // glfw window creation
     // --------------------
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "rubikscube", NULL, NULL);
@@ -169,38 +636,114 @@ int main()
 
     // Access Camera
     VideoCapture cap;
-    int deviceID = 0;           // 0 = open default camera
-    int apiID = cv::CAP_ANY;    // 0 = autodetect default API
-    // open selected camera using selected API
-    cap.open(deviceID, apiID);
-    // check if we succeeded
-    if (!cap.isOpened()) {
-        std::cerr << "ERROR! Unable to open camera\n";
-        return -1;
+    FrameSource *source;
+    if (!replayPath.empty()) {
+        ReplaySource *replay = new ReplaySource(replayRealtime);
+        if (!replay->open(replayPath)) {
+            return -1;
+        }
+        source = replay;
+    } else if (synthetic) {
+        source = new SyntheticSource(640, 480);
+    } else {
+        int deviceID = 0;           // 0 = open default camera
+        int apiID = cv::CAP_ANY;    // 0 = autodetect default API
+        // open selected camera using selected API
+        cap.open(deviceID, apiID);
+        // check if we succeeded
+        if (!cap.isOpened()) {
+            std::cerr << "ERROR! Unable to open camera\n";
+            return -1;
+        }
+        source = new CameraSource(&cap);
     }
 
+    // Record what the source delivers, right where frames are read
+    FrameRecorder recorder;
+    if (!recordPath.empty()) {
+        if (!recorder.open(recordPath)) {
+            return -1;
+        }
+        source = new RecordingSource(source, &recorder);
+    }
+
+    QualityGovernor governor(targetFrameMs);
+    source->setResolution(governor.level().captureWidth, governor.level().captureHeight);
+
+    LatencyHarness *latency = measureLatency ? new LatencyHarness() : NULL;
+
     initTexture();
 
     initBackground();
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    for (long frameCount = 0; !glfwWindowShouldClose(window) && !source->finished() && frameCount != maxFrames;
+         frameCount++)
     {
+        governor.beginFrame();
         processInput(window);
 
         // camera
         // ------
-        imageProcessing(&cap);
+        imageProcessing(source, &governor, latency);
+        if (solvePending && solverReady) {
+            solvePending = false;
+            startSolving(solverService);
+        }
+        showBestSolution(window);
 
         // do the rendering
         render();
+        governor.stageDone(STAGE_RENDER);
+
+        // from here on the loop waits for the GPU and the display, which the governor does not count as work
+        // read back the counter of the synthetic frame that is about to be presented
+        long shownCounter = -1;
+        if (latency && synthetic && textureStamp.index >= 0) {
+            int fbWidth, fbHeight;
+            glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+            shownCounter = latency->decodeCounter(fbWidth, fbHeight, textureStamp.frameSize);
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
+        if (latency) {
+            // wait for the GPU so the present time is not just the time the swap was queued
+            glFinish();
+            double presentMs = nowMs();
+            latency->presented(textureStamp, presentMs);
+            if (synthetic) {
+                latency->presentedDecoded(shownCounter, presentMs);
+            }
+        }
         glfwPollEvents();
+        governor.stageDone(STAGE_PRESENT);
+
+        // quality governor: trade resolution for frame time
+        // -------------------------------------------------
+        QualityLevel previous = governor.level();
+        if (governor.endFrame() && governor.level().captureWidth != previous.captureWidth) {
+            source->setResolution(governor.level().captureWidth, governor.level().captureHeight);
+        }
+    }
+
+    if (!cachePath.empty() && solverReady) {
+        SolutionCache::Stats stats = solutionCache.stats();
+        std::cout << "[solver] cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions
+                  << " evictions" << std::endl;
+        if (solutionCache.save(cachePath)) {
+            std::cout << "[solver] " << stats.entries << " cached solutions written to " << cachePath << std::endl;
+        }
+    }
+    if (latency) {
+        latency->report();
+        delete latency;
     }
+    recorder.close();
+    delete source;
+    delete undistorter;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------